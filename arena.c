@@ -0,0 +1,101 @@
+/* arena.c */
+
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Initialize an empty arena; the first block is allocated on first use */
+void arena_init(Arena *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size;
+    arena->bytes_reserved = 0;
+    arena->bytes_used = 0;
+}
+
+/* Allocate a new block able to hold at least min_size bytes.
+ * Large requests get a dedicated block linked behind the head, so the
+ * partially used head block keeps serving small allocations. */
+static ArenaBlock *arena_new_block(Arena *arena, size_t min_size) {
+    size_t size = arena->block_size;
+    int dedicated = min_size > size / 4;
+    if (min_size > size) {
+        size = min_size;
+    }
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    block->size = size;
+    block->used = 0;
+    if (dedicated && arena->head) {
+        block->next = arena->head->next;
+        arena->head->next = block;
+    } else {
+        block->next = arena->head;
+        arena->head = block;
+    }
+    arena->bytes_reserved += size;
+    return block;
+}
+
+/* Allocate size bytes aligned to alignment (a power of two) */
+void *arena_alloc(Arena *arena, size_t size, size_t alignment) {
+    ArenaBlock *block = arena->head;
+    if (block) {
+        uintptr_t base = (uintptr_t)block->data;
+        size_t offset = ((base + block->used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (offset + size <= block->size) {
+            block->used = offset + size;
+            arena->bytes_used += size;
+            return block->data + offset;
+        }
+    }
+
+    /* The malloc'd block data is aligned for any fundamental type */
+    block = arena_new_block(arena, size);
+    block->used = size;
+    arena->bytes_used += size;
+    return block->data;
+}
+
+/* Copy length bytes of str into the arena and terminate them with '\0' */
+char *arena_strndup(Arena *arena, const char *str, size_t length) {
+    char *copy = arena_alloc(arena, length + 1, 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/* Release every allocation but keep the most recent block for reuse */
+void arena_reset(Arena *arena) {
+    if (!arena->head) {
+        return;
+    }
+    ArenaBlock *keep = arena->head;
+    ArenaBlock *block = keep->next;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    keep->next = NULL;
+    keep->used = 0;
+    arena->bytes_reserved = keep->size;
+    arena->bytes_used = 0;
+}
+
+/* Release all blocks */
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->bytes_reserved = 0;
+    arena->bytes_used = 0;
+}
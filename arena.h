@@ -0,0 +1,33 @@
+/* arena.h */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+/* Bump allocator: memory is carved out of large blocks and can only be
+ * released all at once. Pointers stay valid until arena_reset/arena_free. */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *head;
+    size_t block_size;
+    size_t bytes_reserved;  /* total size of all blocks */
+    size_t bytes_used;      /* total size of all allocations */
+} Arena;
+
+/* Arena Functions */
+void arena_init(Arena *arena, size_t block_size);
+void *arena_alloc(Arena *arena, size_t size, size_t alignment);
+char *arena_strndup(Arena *arena, const char *str, size_t length);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,129 @@
+/* batch_queue.c */
+
+#include "batch_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocate an empty batch */
+void token_batch_init(TokenBatch *batch, size_t capacity) {
+    batch->data = malloc(capacity);
+    if (!batch->data) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    batch->used = 0;
+    batch->capacity = capacity;
+}
+
+/* Append a word; returns 0 if the batch is too full to take it.
+ * A word larger than an empty batch grows the batch instead. */
+int token_batch_add(TokenBatch *batch, const char *word, size_t length) {
+    size_t needed = sizeof(uint32_t) + length;
+    if (batch->used + needed > batch->capacity) {
+        if (batch->used > 0) {
+            return 0;
+        }
+        char *temp = realloc(batch->data, needed);
+        if (!temp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        batch->data = temp;
+        batch->capacity = needed;
+    }
+    uint32_t length32 = (uint32_t)length;
+    memcpy(batch->data + batch->used, &length32, sizeof(length32));
+    memcpy(batch->data + batch->used + sizeof(length32), word, length);
+    batch->used += needed;
+    return 1;
+}
+
+/* Iterate over the words of a batch: start with *position = 0 and call until it returns 0 */
+int token_batch_next(const TokenBatch *batch, size_t *position, const char **word, uint32_t *length) {
+    if (*position >= batch->used) {
+        return 0;
+    }
+    memcpy(length, batch->data + *position, sizeof(*length));
+    *word = batch->data + *position + sizeof(*length);
+    *position += sizeof(*length) + *length;
+    return 1;
+}
+
+/* Release a batch's buffer */
+void token_batch_free(TokenBatch *batch) {
+    free(batch->data);
+    batch->data = NULL;
+    batch->used = batch->capacity = 0;
+}
+
+/* Initialize a queue fed by num_producers splitters */
+void batch_queue_init(BatchQueue *queue, int num_producers) {
+    queue->items = malloc(BATCH_QUEUE_CAPACITY * sizeof(TokenBatch));
+    if (!queue->items) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    queue->head = 0;
+    queue->count = 0;
+    queue->open_producers = num_producers;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+/* Hand a batch over to the consumer, blocking while the queue is full.
+ * The queue takes ownership of the buffer and *batch is left empty. */
+void batch_queue_push(BatchQueue *queue, TokenBatch *batch) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == BATCH_QUEUE_CAPACITY) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->items[(queue->head + queue->count) % BATCH_QUEUE_CAPACITY] = *batch;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+
+    batch->data = NULL;
+    batch->used = batch->capacity = 0;
+}
+
+/* Take the oldest batch, blocking while the queue is empty.
+ * Returns 0 once the queue is empty and every producer has closed it. */
+int batch_queue_pop(BatchQueue *queue, TokenBatch *batch) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && queue->open_producers > 0) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+    *batch = queue->items[queue->head];
+    queue->head = (queue->head + 1) % BATCH_QUEUE_CAPACITY;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+/* A producer is done; the consumer sees end of input after the last one */
+void batch_queue_close(BatchQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->open_producers--;
+    if (queue->open_producers == 0) {
+        pthread_cond_broadcast(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Free the queue and any batches still in it */
+void batch_queue_free(BatchQueue *queue) {
+    for (size_t i = 0; i < queue->count; i++) {
+        token_batch_free(&queue->items[(queue->head + i) % BATCH_QUEUE_CAPACITY]);
+    }
+    free(queue->items);
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+}
@@ -0,0 +1,51 @@
+/* batch_queue.h */
+
+#ifndef BATCH_QUEUE_H
+#define BATCH_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * In-memory replacement for a splitter -> builder pipe in the threaded
+ * engine. Splitter threads pack words into batches of
+ *   [u32 length][length bytes]
+ * records and push whole batches; the builder thread pops them. The queue is
+ * bounded, so fast splitters block instead of buffering the whole input, and
+ * it reports end of input once every producer has closed its side.
+ */
+
+#define BATCH_SIZE (64 * 1024)
+#define BATCH_QUEUE_CAPACITY 64
+
+typedef struct TokenBatch {
+    char *data;
+    size_t used;
+    size_t capacity;
+} TokenBatch;
+
+typedef struct BatchQueue {
+    TokenBatch *items;          /* ring of BATCH_QUEUE_CAPACITY batches */
+    size_t head;
+    size_t count;
+    int open_producers;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} BatchQueue;
+
+/* Batch Functions */
+void token_batch_init(TokenBatch *batch, size_t capacity);
+int token_batch_add(TokenBatch *batch, const char *word, size_t length);
+int token_batch_next(const TokenBatch *batch, size_t *position, const char **word, uint32_t *length);
+void token_batch_free(TokenBatch *batch);
+
+/* Queue Functions */
+void batch_queue_init(BatchQueue *queue, int num_producers);
+void batch_queue_push(BatchQueue *queue, TokenBatch *batch);
+int batch_queue_pop(BatchQueue *queue, TokenBatch *batch);
+void batch_queue_close(BatchQueue *queue);
+void batch_queue_free(BatchQueue *queue);
+
+#endif
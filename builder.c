@@ -4,12 +4,199 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/time.h> 
+#include <errno.h>
+#include <poll.h>
 #include "hash_table.h"
+#include "wire.h"
+#include "topk.h"
+#include "ring.h"
+#include "stats.h"
+#include "sketch.h"
+#include "spill.h"
 
 #define MAX_WORD_LENGTH 100
 
-int main() {
+// Count every complete word frame buffered in the reader; frames from a
+// combining splitter carry the number of occurrences they stand for.
+// Approximate builders (approx != NULL) count into their sketch instead.
+// Returns 0, or -1 if the stream is malformed.
+static int count_words(WireReader *reader, HashTable *hash_table, ApproxCounter *approx, BuilderStats *stats) {
+    const char *word;
+    uint32_t length;
+    uint64_t count;
+    int status;
+    while ((status = wire_next_counted_word(reader, &word, &length, &count)) == 1) {
+        if (length > 0 && approx) {
+            approx_counter_add(approx, word, length, count);
+        } else if (length > 0) {
+            insert_or_update_word_n(hash_table, word, length, count);
+        }
+        stats->frames_received++;
+        stats->tokens_received += count;
+    }
+    if (status == -1) {
+        fprintf(stderr, "Builder received a malformed word frame.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Send an approximate builder's sketch, row by row, and then its heavy hitters
+// with their error bounds. Returns 0, or -1 if writing failed.
+static int send_approx_counts(WireWriter *writer, const ApproxCounter *approx) {
+    const CountMinSketch *sketch = &approx->sketch;
+    WireSketchRow header = {
+        .depth = sketch->depth,
+        .width = sketch->width,
+        .floor = space_saving_floor(&approx->heavy_hitters),
+    };
+    for (uint32_t row = 0; row < sketch->depth; row++) {
+        header.row = row;
+        if (wire_write_sketch_row(writer, &header, &sketch->counters[(size_t)row * sketch->width]) == -1) {
+            return -1;
+        }
+    }
+    const SpaceSaving *list = &approx->heavy_hitters;
+    for (size_t i = 0; i < list->size; i++) {
+        const HeavyHitter *entry = &list->entries[i];
+        if (wire_write_bounded_count(writer, entry->word, entry->length, entry->count, entry->error) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Where merged words go once sorted runs are in play (--mem-limit): straight to
+// the root in word order, or through the local top_k
+typedef struct MergeOutput {
+    WireWriter *writer;
+    TopK *top_words;
+    Arena *words;               /* copies of the words kept in top_words */
+    uint64_t total_count;
+    uint64_t distinct_words;
+} MergeOutput;
+
+static int emit_merged_word(const char *word, uint32_t length, uint64_t count, void *context) {
+    MergeOutput *out = context;
+    out->total_count += count;
+    out->distinct_words++;
+    if (out->top_words->capacity == 0) {
+        return wire_write_count(out->writer, word, length, count);
+    }
+    // Only words that make it into the heap are copied
+    WordCount candidate = { .word = word, .count = count };
+    TopK *top = out->top_words;
+    if (top->size < top->capacity || word_count_precedes(&candidate, &top->heap[0])) {
+        topk_offer(top, arena_strndup(out->words, word, length), count);
+    }
+    return 0;
+}
+
+// Spill the table to a sorted run once it outgrows the memory budget
+static int check_memory_limit(HashTable **hash_table, SpillSet *spills, uint64_t mem_limit, BuilderStats *stats) {
+    if (mem_limit == 0 || hash_table_memory(*hash_table) <= mem_limit) {
+        return 0;
+    }
+    if (spill_table(spills, hash_table) == -1) {
+        perror("spill sorted run");
+        return -1;
+    }
+    stats->spilled_runs++;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 7) {
+        fprintf(stderr, "Usage: %s <input_fds> <top_k> <stats_spec> <builder_id> <approx_capacity> <mem_limit> [<ring_spec> <wait_fd>]\n", argv[0]);
+        return 1;
+    }
 
+    // With top_k > 0 this builder owns its words exclusively (hash routing), so its
+    // local top_k contains every word of the global top_k that it owns and only
+    // those entries are sent to the root. With top_k == 0 the whole table is sent.
+    int top_k = atoi(argv[2]);
+    if (top_k < 0) {
+        fprintf(stderr, "Invalid top_k value: %s\n", argv[2]);
+        return 1;
+    }
+
+    // The builder's counters end up in its slot of lexan's stats region (stats.h)
+    int builder_id = atoi(argv[4]);
+    StatsRegion stats;
+    if (stats_region_map(&stats, argv[3]) == -1 || builder_id < 0 || builder_id >= stats.num_builders) {
+        fprintf(stderr, "Invalid stats region: %s\n", argv[3]);
+        return 1;
+    }
+    BuilderStats *my_stats = &stats.builders[builder_id];
+
+    // With approx_capacity > 0 (--approx) the builder keeps a Count-Min Sketch and a
+    // list of that many heavy hitters (sketch.h) instead of a table of every word
+    int approx_capacity = atoi(argv[5]);
+    if (approx_capacity < 0) {
+        fprintf(stderr, "Invalid approximation capacity: %s\n", argv[5]);
+        return 1;
+    }
+
+    // With mem_limit > 0 (--mem-limit) the table is spilled to sorted runs on disk
+    // whenever it grows past mem_limit bytes, and every word is sent in word order
+    uint64_t mem_limit = strtoull(argv[6], NULL, 10);
+    SpillSet spills;
+    spill_init(&spills);
+
+    // Parse the read ends of the pipes from every splitter
+    int num_inputs = 0;
+    for (char *p = argv[1]; *p; p++) {
+        if (*p != ' ' && (p == argv[1] || p[-1] == ' ')) {
+            num_inputs++;
+        }
+    }
+    struct pollfd *poll_fds = malloc((num_inputs + 1) * sizeof(struct pollfd));
+    WireReader *readers = malloc((num_inputs + 1) * sizeof(WireReader));
+    if (!poll_fds || !readers) {
+        perror("malloc");
+        return 1;
+    }
+    int fd_count = 0;
+    char *token = strtok(argv[1], " ");
+    while (token != NULL && fd_count < num_inputs) {
+        poll_fds[fd_count].fd = atoi(token);
+        poll_fds[fd_count].events = POLLIN;
+        fd_count++;
+        token = strtok(NULL, " ");
+    }
+
+    // With the shared-memory transport (ring.h) the inputs are rings in lexan's memfd,
+    // one per splitter, and the fds are the splitters' eventfds used to wake them up
+    // when a full ring gets space again
+    RingRegion ring_region;
+    Ring *rings = NULL;
+    int wait_fd = -1;
+    if (argc >= 9) {
+        if (ring_region_map(&ring_region, argv[7]) == -1) {
+            perror("map builder rings");
+            return 1;
+        }
+        if (builder_id < 0 || builder_id >= ring_region.num_builders || fd_count > ring_region.num_splitters) {
+            fprintf(stderr, "Invalid ring layout: %s\n", argv[7]);
+            return 1;
+        }
+        rings = malloc(fd_count * sizeof(Ring));
+        if (!rings) {
+            perror("malloc");
+            return 1;
+        }
+        wait_fd = atoi(argv[8]);
+        for (int i = 0; i < fd_count; i++) {
+            ring_attach(&rings[i], &ring_region, i, builder_id, wait_fd, poll_fds[i].fd);
+        }
+    }
+    for (int i = 0; i < fd_count; i++) {
+        if (rings) {
+            wire_reader_init_ring(&readers[i], &rings[i], WIRE_BUFFER_SIZE);
+        } else {
+            wire_reader_init(&readers[i], poll_fds[i].fd, WIRE_BUFFER_SIZE);
+        }
+    }
 
     // Measure start time
     struct timeval start_time, end_time;
@@ -18,32 +205,154 @@ int main() {
         return 1;
     }
 
-    // Create the hash table
+    // Create the hash table, or the approximate counter
     HashTable *hash_table = create_hash_table();
     if (!hash_table) {
         fprintf(stderr, "Failed to create hash table.\n");
         return 1;
     }
+    ApproxCounter approx_counter;
+    ApproxCounter *approx = NULL;
+    if (approx_capacity > 0) {
+        approx_counter_init(&approx_counter, (size_t)approx_capacity);
+        approx = &approx_counter;
+    }
 
-    char buffer[256];
-    while (fgets(buffer, sizeof(buffer), stdin) != NULL) {
-        buffer[strcspn(buffer, "\n")] = '\0'; // Remove newline
-        if (strlen(buffer) > 0) {
-            insert_word(hash_table, buffer);
+    // Read framed words from all splitters (see wire.h) as they become available
+    int open_inputs = fd_count;
+    while (rings && open_inputs > 0) {
+        // Drain every ring; sleep only after all of them were found empty, which
+        // also asked their splitters to signal wait_fd on the next write
+        int idle = 1;
+        for (int i = 0; i < fd_count; i++) {
+            if (poll_fds[i].fd < 0) {
+                continue;
+            }
+            ssize_t n = wire_reader_fill(&readers[i]);
+            if (n == -1 && errno == EAGAIN) {
+                continue;
+            }
+            if (n == -1) {
+                perror("read from splitter ring");
+                return 1;
+            }
+            idle = 0;
+            if (count_words(&readers[i], hash_table, approx, my_stats) == -1 ||
+                check_memory_limit(&hash_table, &spills, mem_limit, my_stats) == -1) {
+                return 1;
+            }
+            if (n == 0) {
+                if (wire_reader_pending(&readers[i]) > 0) {
+                    fprintf(stderr, "Builder received a truncated word frame.\n");
+                    return 1;
+                }
+                poll_fds[i].fd = -1;
+                my_stats->bytes_read += readers[i].bytes_read;
+                wire_reader_free(&readers[i]);
+                open_inputs--;
+            }
+        }
+        if (idle) {
+            double wait_start = stats_now();
+            if (ring_wait(wait_fd) == -1) {
+                perror("wait for splitter rings");
+                return 1;
+            }
+            my_stats->blocked_time += stats_now() - wait_start;
         }
     }
+    // Pipes: wait with poll() until some splitter's pipe is readable
+    while (!rings && open_inputs > 0) {
+        double wait_start = stats_now();
+        int ready = poll(poll_fds, fd_count, -1);
+        my_stats->blocked_time += stats_now() - wait_start;
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+
+        for (int i = 0; i < fd_count; i++) {
+            if (poll_fds[i].fd < 0 || !(poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+
+            ssize_t n = wire_reader_fill(&readers[i]);
+            if (n == -1) {
+                perror("read from splitter");
+                return 1;
+            }
+
+            if (count_words(&readers[i], hash_table, approx, my_stats) == -1 ||
+                check_memory_limit(&hash_table, &spills, mem_limit, my_stats) == -1) {
+                return 1;
+            }
 
-    // Output word counts
-    for (int i = 0; i < hash_table->size; i++) {
-        WordCount *node = hash_table->buckets[i];
-        while (node) {
-            printf("%s %d\n", node->word, node->count);
-            node = node->next;
+            if (n == 0) {
+                if (wire_reader_pending(&readers[i]) > 0) {
+                    fprintf(stderr, "Builder received a truncated word frame.\n");
+                    return 1;
+                }
+                close(poll_fds[i].fd);
+                poll_fds[i].fd = -1;
+                my_stats->bytes_read += readers[i].bytes_read;
+                wire_reader_free(&readers[i]);
+                open_inputs--;
+            }
         }
     }
+    free(poll_fds);
+    free(readers);
+    if (rings) {
+        free(rings);
+        ring_region_unmap(&ring_region);
+    }
 
-    // Flush stdout to ensure all word counts are sent
-    fflush(stdout);
+    // Output word counts: the local top_k, or every word when top_k is 0
+    WireWriter writer;
+    wire_writer_init(&writer, STDOUT_FILENO, WIRE_BUFFER_SIZE);
+    if (approx && send_approx_counts(&writer, approx) == -1) {
+        perror("write sketch to root");
+        return 1;
+    }
+    uint64_t total_count = approx ? approx->total_count : 0;
+    size_t distinct_words = approx ? approx->heavy_hitters.size : hash_table->count;
+    size_t position = 0;
+    WordCount entry;
+    TopK top_words;
+    topk_init(&top_words, (size_t)top_k);
+    Arena top_keys;
+    arena_init(&top_keys, ARENA_BLOCK_SIZE);
+    if (mem_limit > 0) {
+        // Merge the runs with what is left in the table, which replaces the loop below
+        MergeOutput merged = { .writer = &writer, .top_words = &top_words, .words = &top_keys };
+        if (spill_merge(&spills, hash_table, emit_merged_word, &merged) == -1) {
+            perror("merge sorted runs");
+            return 1;
+        }
+        total_count = merged.total_count;
+        distinct_words = merged.distinct_words;
+        my_stats->spilled_bytes = spills.bytes_written;
+        spill_free(&spills);
+    }
+    while (mem_limit == 0 && hash_table_next(hash_table, &position, &entry)) {
+        total_count += entry.count;
+        if (top_k > 0) {
+            topk_offer(&top_words, entry.word, entry.count);
+        } else if (wire_write_count(&writer, entry.word, strlen(entry.word), entry.count) == -1) {
+            perror("write word count to root");
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < top_words.size; i++) {
+        const WordCount *selected = &top_words.heap[i];
+        if (wire_write_count(&writer, selected->word, strlen(selected->word), selected->count) == -1) {
+            perror("write word count to root");
+            return 1;
+        }
+    }
+    topk_free(&top_words);
+    arena_free(&top_keys);
 
     // Measure end time
     if (gettimeofday(&end_time, NULL) == -1) {
@@ -54,9 +363,29 @@ int main() {
     double elapsed_time = (end_time.tv_sec - start_time.tv_sec) +
                           (end_time.tv_usec - start_time.tv_usec) / 1e6;
 
-    // Send timing information with a special prefix
-    printf("TIME %.6f\n", elapsed_time);
-    fflush(stdout); // Ensure the timing info is sent
+    // Send timing information in the trailer record and flush everything to the root
+    WireTrailer trailer = {
+        .elapsed_time = elapsed_time,
+        .total_count = total_count,
+        .distinct_words = distinct_words,
+    };
+    if (wire_write_trailer(&writer, &trailer) == -1 || wire_flush(&writer) == -1) {
+        perror("write trailer to root");
+        return 1;
+    }
+    // Record the builder's counters before notifying the root
+    my_stats->bytes_written = writer.bytes_written;
+    my_stats->distinct_words = distinct_words;
+    my_stats->table_resizes = hash_table->resizes;
+    my_stats->table_size = hash_table->size;
+    size_t max_probe;
+    hash_table_probe_stats(hash_table, &my_stats->mean_probe_length, &max_probe);
+    my_stats->max_probe_length = max_probe;
+    my_stats->elapsed_time = elapsed_time;
+    stats_usage(&my_stats->usage, RUSAGE_SELF);
+    my_stats->reported = 1;
+    stats_region_unmap(&stats);
+    wire_writer_free(&writer);
 
     // Notify the root process
     if (kill(getppid(), SIGUSR2) == -1) {
@@ -66,6 +395,9 @@ int main() {
 
     // Clean up
     free_hash_table(hash_table);
+    if (approx) {
+        approx_counter_free(approx);
+    }
 
     return 0;
 }
@@ -0,0 +1,132 @@
+/* chunk_queue.c */
+
+#define _GNU_SOURCE
+#include "chunk_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+static size_t chunk_queue_size(const ChunkQueueHeader *header) {
+    return sizeof(ChunkQueueHeader) + header->num_chunks * sizeof(Chunk) + header->num_files * sizeof(uint64_t) +
+           header->names_size;
+}
+
+/* Point the queue at the sections that follow the header */
+static void chunk_queue_locate(ChunkQueue *queue) {
+    queue->header = queue->block;
+    queue->chunks = (const Chunk *)((char *)queue->block + sizeof(ChunkQueueHeader));
+    queue->name_offsets = (const uint64_t *)(queue->chunks + queue->header->num_chunks);
+    queue->names = (const char *)(queue->name_offsets + queue->header->num_files);
+}
+
+/* Create the shared queue from the input files and their byte ranges, which
+ * are handed out in the order given */
+int chunk_queue_create(ChunkQueue *queue, const char *const *files, size_t num_files, const Chunk *chunks,
+                       size_t num_chunks) {
+    ChunkQueueHeader header;
+    memset(&header, 0, sizeof(header));
+    header.num_chunks = num_chunks;
+    header.num_files = num_files;
+    for (size_t i = 0; i < num_files; i++) {
+        header.names_size += strlen(files[i]) + 1;
+    }
+    queue->size = chunk_queue_size(&header);
+    queue->fd = memfd_create("lexan-chunks", 0);
+    if (queue->fd == -1) {
+        return -1;
+    }
+    if (ftruncate(queue->fd, (off_t)queue->size) == -1) {
+        close(queue->fd);
+        return -1;
+    }
+    queue->block = mmap(NULL, queue->size, PROT_READ | PROT_WRITE, MAP_SHARED, queue->fd, 0);
+    if (queue->block == MAP_FAILED) {
+        close(queue->fd);
+        return -1;
+    }
+
+    ChunkQueueHeader *shared = queue->block;
+    memcpy(shared->magic, CHUNK_QUEUE_MAGIC, sizeof(shared->magic));
+    atomic_init(&shared->next, 0);
+    shared->num_chunks = num_chunks;
+    shared->num_files = num_files;
+    shared->names_size = header.names_size;
+    chunk_queue_locate(queue);
+    memcpy((Chunk *)queue->chunks, chunks, num_chunks * sizeof(Chunk));
+    uint64_t *name_offsets = (uint64_t *)queue->name_offsets;
+    char *names = (char *)queue->names;
+    uint64_t used = 0;
+    for (size_t i = 0; i < num_files; i++) {
+        size_t length = strlen(files[i]) + 1;
+        name_offsets[i] = used;
+        memcpy(names + used, files[i], length);
+        used += length;
+    }
+    return 0;
+}
+
+/* Map a queue created by lexan from its spec string */
+int chunk_queue_map(ChunkQueue *queue, const char *spec) {
+    char *end;
+    long fd = strtol(spec, &end, 10);
+    if (end == spec || *end != '\0' || fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    queue->fd = (int)fd;
+
+    /* Map the header first to learn how many chunks and files follow */
+    ChunkQueueHeader header;
+    if (pread(queue->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, CHUNK_QUEUE_MAGIC, sizeof(header.magic)) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    queue->size = chunk_queue_size(&header);
+    queue->block = mmap(NULL, queue->size, PROT_READ | PROT_WRITE, MAP_SHARED, queue->fd, 0);
+    if (queue->block == MAP_FAILED) {
+        return -1;
+    }
+    chunk_queue_locate(queue);
+    for (size_t i = 0; i < queue->header->num_chunks; i++) {
+        if (queue->chunks[i].file >= queue->header->num_files) {
+            munmap(queue->block, queue->size);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Describe the queue for chunk_queue_map in a child process */
+void chunk_queue_spec(const ChunkQueue *queue, char *spec, size_t size) {
+    snprintf(spec, size, "%d", queue->fd);
+}
+
+/* Claim the next chunk. Returns 1 with its file and range, or 0 once all chunks are taken. */
+int chunk_queue_next(ChunkQueue *queue, size_t *file, off_t *offset, off_t *length) {
+    uint64_t index = atomic_fetch_add_explicit(&queue->header->next, 1, memory_order_relaxed);
+    if (index >= queue->header->num_chunks) {
+        return 0;
+    }
+    *file = (size_t)queue->chunks[index].file;
+    *offset = (off_t)queue->chunks[index].offset;
+    *length = (off_t)queue->chunks[index].length;
+    return 1;
+}
+
+/* Name of an input file, valid while the queue is mapped */
+const char *chunk_queue_file(const ChunkQueue *queue, size_t file) {
+    return queue->names + queue->name_offsets[file];
+}
+
+/* Unmap the queue and close its descriptor */
+void chunk_queue_unmap(ChunkQueue *queue) {
+    munmap(queue->block, queue->size);
+    close(queue->fd);
+    queue->block = NULL;
+    queue->fd = -1;
+}
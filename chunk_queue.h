@@ -0,0 +1,63 @@
+/* chunk_queue.h */
+
+#ifndef CHUNK_QUEUE_H
+#define CHUNK_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/*
+ * Shared list of input chunks that splitters pull work from.
+ *
+ * lexan cuts every input file into delimiter-aligned chunks and writes them,
+ * with the file names, to a memfd laid out as
+ *   [ChunkQueueHeader][Chunk x num_chunks][u64 name offset x num_files][names]
+ * where each name is '\0'-terminated and each chunk is a byte range of one
+ * file. Every splitter maps it and claims the next chunk with an atomic
+ * fetch-and-add on the shared cursor, so splitters that run fast keep
+ * taking chunks until the input is exhausted instead of idling while the
+ * slowest one finishes a fixed share. Child processes find the queue
+ * through its spec string, the memfd's descriptor number.
+ */
+
+#define CHUNK_QUEUE_MAGIC "LXCHUNK2"
+#define CHUNK_QUEUE_SPEC_SIZE 16
+#define CHUNKS_PER_SPLITTER 16                  /* default number of chunks per splitter */
+#define MIN_CHUNK_SIZE (1024 * 1024)            /* default chunks are at least this large */
+
+typedef struct ChunkQueueHeader {
+    char magic[8];
+    _Atomic uint64_t next;                      /* index of the next unclaimed chunk */
+    uint64_t num_chunks;
+    uint64_t num_files;
+    uint64_t names_size;                        /* bytes of names, including their '\0's */
+} ChunkQueueHeader;
+
+typedef struct Chunk {
+    uint64_t file;                              /* index into the file names */
+    uint64_t offset;
+    uint64_t length;
+} Chunk;
+
+typedef struct ChunkQueue {
+    int fd;
+    void *block;
+    size_t size;
+    ChunkQueueHeader *header;
+    const Chunk *chunks;
+    const uint64_t *name_offsets;
+    const char *names;
+} ChunkQueue;
+
+/* Chunk Queue Functions */
+int chunk_queue_create(ChunkQueue *queue, const char *const *files, size_t num_files, const Chunk *chunks,
+                       size_t num_chunks);
+int chunk_queue_map(ChunkQueue *queue, const char *spec);
+void chunk_queue_spec(const ChunkQueue *queue, char *spec, size_t size);
+int chunk_queue_next(ChunkQueue *queue, size_t *file, off_t *offset, off_t *length);
+const char *chunk_queue_file(const ChunkQueue *queue, size_t file);
+void chunk_queue_unmap(ChunkQueue *queue);
+
+#endif
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "hash_table.h"
+#include "arena.h"
+
+/*
+ * Synthetic corpus generator for the benchmark suite (make bench).
+ *
+ * Draws words from a vocabulary of distinct random lowercase words with
+ * Zipf-distributed frequencies: rank r is chosen with probability
+ * proportional to 1 / r^skew. A small share of words is capitalized or
+ * followed by punctuation so the tokenizer's cleaning path is exercised.
+ * A fraction of the vocabulary, picked at random, is written to the
+ * exclusion list. The same seed always produces the same files.
+ */
+
+#define MIN_WORD_LENGTH 2
+#define MAX_WORD_LENGTH 12
+#define DECORATE_PERCENT 8          /* words followed by punctuation */
+#define CAPITALIZE_PERCENT 5        /* words written with a capital letter */
+
+typedef struct Options {
+    unsigned long long size;
+    size_t vocabulary;
+    double skew;
+    int words_per_line;
+    double exclusion_ratio;
+    uint64_t seed;
+    const char *corpus_file;
+    const char *exclusion_file;
+} Options;
+
+/* splitmix64: small, fast and good enough for synthetic text */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/* Uniform double in [0, 1) */
+static double next_uniform(uint64_t *state) {
+    return (double)(next_random(state) >> 11) / 9007199254740992.0;
+}
+
+/* Parse a byte count with an optional K, M or G suffix */
+static int parse_size(const char *text, unsigned long long *size) {
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0) {
+        return -1;
+    }
+    switch (*end) {
+        case 'K': case 'k': value *= 1024; end++; break;
+        case 'M': case 'm': value *= 1024 * 1024; end++; break;
+        case 'G': case 'g': value *= 1024.0 * 1024 * 1024; end++; break;
+        default: break;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *size = (unsigned long long)value;
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s -s size[K|M|G] -o corpus_file -e exclusion_file [-v vocabulary] [-z skew] "
+                    "[-w words_per_line] [-x exclusion_ratio] [-S seed]\n", program);
+}
+
+/* Build the vocabulary: distinct random words, stored in the arena */
+static char **make_vocabulary(size_t count, uint64_t *state, Arena *arena) {
+    char **words = malloc(count * sizeof(char *));
+    if (!words) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    HashTable *seen = create_hash_table();
+    char buffer[MAX_WORD_LENGTH + 1];
+    size_t made = 0;
+    while (made < count) {
+        size_t length = MIN_WORD_LENGTH + next_random(state) % (MAX_WORD_LENGTH - MIN_WORD_LENGTH + 1);
+        for (size_t i = 0; i < length; i++) {
+            buffer[i] = (char)('a' + next_random(state) % 26);
+        }
+        size_t before = seen->count;
+        insert_or_update_word_n(seen, buffer, length, 1);
+        if (seen->count == before) {
+            continue;
+        }
+        words[made++] = arena_strndup(arena, buffer, length);
+    }
+    free_hash_table(seen);
+    return words;
+}
+
+/* Cumulative Zipf weights of ranks 1..count */
+static double *make_zipf_table(size_t count, double skew) {
+    double *cumulative = malloc(count * sizeof(double));
+    if (!cumulative) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    double total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += 1.0 / pow((double)(i + 1), skew);
+        cumulative[i] = total;
+    }
+    return cumulative;
+}
+
+/* Pick a rank by binary search over the cumulative weights */
+static size_t sample_rank(const double *cumulative, size_t count, uint64_t *state) {
+    double target = next_uniform(state) * cumulative[count - 1];
+    size_t low = 0, high = count - 1;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (cumulative[middle] <= target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int main(int argc, char *argv[]) {
+    Options options = { 0, 50000, 1.0, 12, 0.01, 42, NULL, NULL };
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 's':
+                if (parse_size(value, &options.size) == -1) {
+                    fprintf(stderr, "Invalid size: %s\n", value);
+                    return 1;
+                }
+                break;
+            case 'v':
+                options.vocabulary = (size_t)strtoull(value, NULL, 10);
+                break;
+            case 'z':
+                options.skew = strtod(value, NULL);
+                break;
+            case 'w':
+                options.words_per_line = atoi(value);
+                break;
+            case 'x':
+                options.exclusion_ratio = strtod(value, NULL);
+                break;
+            case 'S':
+                options.seed = strtoull(value, NULL, 10);
+                break;
+            case 'o':
+                options.corpus_file = value;
+                break;
+            case 'e':
+                options.exclusion_file = value;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (options.size == 0 || !options.corpus_file || !options.exclusion_file || options.vocabulary == 0 ||
+        options.skew < 0 || options.words_per_line <= 0 || options.exclusion_ratio < 0 || options.exclusion_ratio > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint64_t state = options.seed;
+    Arena arena;
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    char **words = make_vocabulary(options.vocabulary, &state, &arena);
+    double *cumulative = make_zipf_table(options.vocabulary, options.skew);
+
+    // The excluded words are drawn independently of their rank
+    FILE *exclusion_fp = fopen(options.exclusion_file, "w");
+    if (!exclusion_fp) {
+        perror("fopen exclusion_file");
+        return 1;
+    }
+    size_t num_excluded = 0;
+    for (size_t i = 0; i < options.vocabulary; i++) {
+        if (next_uniform(&state) < options.exclusion_ratio) {
+            fprintf(exclusion_fp, "%s\n", words[i]);
+            num_excluded++;
+        }
+    }
+    fclose(exclusion_fp);
+
+    FILE *corpus_fp = fopen(options.corpus_file, "w");
+    if (!corpus_fp) {
+        perror("fopen corpus_file");
+        return 1;
+    }
+    static const char punctuation[] = ",.;:!?\"";
+    unsigned long long written = 0, tokens = 0;
+    while (written < options.size) {
+        for (int i = 0; i < options.words_per_line; i++) {
+            const char *word = words[sample_rank(cumulative, options.vocabulary, &state)];
+            uint64_t roll = next_random(&state) % 100;
+            if (i > 0) {
+                fputc(' ', corpus_fp);
+                written++;
+            }
+            if (roll < CAPITALIZE_PERCENT) {
+                fputc(word[0] - 'a' + 'A', corpus_fp);
+                fputs(word + 1, corpus_fp);
+            } else {
+                fputs(word, corpus_fp);
+            }
+            written += strlen(word);
+            if (roll >= 100 - DECORATE_PERCENT) {
+                fputc(punctuation[roll % (sizeof(punctuation) - 1)], corpus_fp);
+                written++;
+            }
+            tokens++;
+        }
+        fputc('\n', corpus_fp);
+        written++;
+    }
+    if (fclose(corpus_fp) == EOF) {
+        perror("fclose corpus_file");
+        return 1;
+    }
+
+    printf("Generated %llu bytes, %llu tokens from %zu words (%zu excluded).\n", written, tokens,
+           options.vocabulary, num_excluded);
+
+    free(cumulative);
+    free(words);
+    arena_free(&arena);
+    return 0;
+}
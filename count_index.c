@@ -0,0 +1,249 @@
+/* count_index.c */
+
+#include "count_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN8(n) (((n) + 7) & ~(uint64_t)7)
+
+typedef struct RankEntry {
+    uint64_t count;
+    uint32_t index;
+} RankEntry;
+
+static int compare_words(const void *a, const void *b) {
+    return strcmp(((const WordCount *)a)->word, ((const WordCount *)b)->word);
+}
+
+/* Descending count; equal counts keep word order, as the indices follow it */
+static int compare_ranks(const void *a, const void *b) {
+    const RankEntry *x = a, *y = b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Write zero bytes up to the next multiple of 8 */
+static int write_padding(FILE *fp, uint64_t size) {
+    static const char zeros[8];
+    size_t padding = (size_t)(ALIGN8(size) - size);
+    return padding && fwrite(zeros, 1, padding, fp) != padding ? -1 : 0;
+}
+
+/* Write the index of num_words distinct words to path, through a temporary
+ * file that replaces path only once it is complete. Returns 0, or -1. */
+int count_index_write(const char *path, const WordCount *words, size_t num_words, uint64_t total_count) {
+    if (num_words >= UINT32_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    WordCount *sorted = malloc((num_words ? num_words : 1) * sizeof(WordCount));
+    uint64_t *offsets = malloc((num_words + 1) * sizeof(uint64_t));
+    uint64_t *counts = malloc((num_words ? num_words : 1) * sizeof(uint64_t));
+    RankEntry *rank_entries = malloc((num_words ? num_words : 1) * sizeof(RankEntry));
+    uint32_t *ranks = malloc((num_words ? num_words : 1) * sizeof(uint32_t));
+    uint64_t directory_size = 16;
+    while (directory_size < 2 * (uint64_t)num_words) {
+        directory_size <<= 1;
+    }
+    uint32_t *directory = calloc(directory_size, sizeof(uint32_t));
+    if (!sorted || !offsets || !counts || !rank_entries || !ranks || !directory) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(sorted, words, num_words * sizeof(WordCount));
+    qsort(sorted, num_words, sizeof(WordCount), compare_words);
+    uint64_t pool_size = 0;
+    for (size_t i = 0; i < num_words; i++) {
+        size_t length = strlen(sorted[i].word);
+        offsets[i] = pool_size;
+        counts[i] = sorted[i].count;
+        rank_entries[i].count = sorted[i].count;
+        rank_entries[i].index = (uint32_t)i;
+        pool_size += length + 1;
+
+        uint64_t slot = word_hash(sorted[i].word, length) & (directory_size - 1);
+        while (directory[slot]) {
+            slot = (slot + 1) & (directory_size - 1);
+        }
+        directory[slot] = (uint32_t)i + 1;
+    }
+    offsets[num_words] = pool_size;
+    qsort(rank_entries, num_words, sizeof(RankEntry), compare_ranks);
+    for (size_t i = 0; i < num_words; i++) {
+        ranks[i] = rank_entries[i].index;
+    }
+
+    CountIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COUNT_INDEX_MAGIC, sizeof(header.magic));
+    header.num_words = num_words;
+    header.total_count = total_count;
+    header.directory_size = directory_size;
+    header.offsets_offset = ALIGN8(sizeof(header));
+    header.counts_offset = header.offsets_offset + (num_words + 1) * sizeof(uint64_t);
+    header.ranks_offset = header.counts_offset + num_words * sizeof(uint64_t);
+    header.directory_offset = header.ranks_offset + ALIGN8(num_words * sizeof(uint32_t));
+    header.pool_offset = header.directory_offset + ALIGN8(directory_size * sizeof(uint32_t));
+    header.pool_size = pool_size;
+    header.file_size = header.pool_offset + pool_size;
+
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    int status = -1;
+    FILE *fp = fopen(temp_path, "wb");
+    if (fp) {
+        status = 0;
+        if (fwrite(&header, sizeof(header), 1, fp) != 1 || write_padding(fp, sizeof(header)) == -1 ||
+            fwrite(offsets, sizeof(uint64_t), num_words + 1, fp) != num_words + 1 ||
+            fwrite(counts, sizeof(uint64_t), num_words, fp) != num_words ||
+            fwrite(ranks, sizeof(uint32_t), num_words, fp) != num_words ||
+            write_padding(fp, num_words * sizeof(uint32_t)) == -1 ||
+            fwrite(directory, sizeof(uint32_t), directory_size, fp) != directory_size ||
+            write_padding(fp, directory_size * sizeof(uint32_t)) == -1) {
+            status = -1;
+        }
+        for (size_t i = 0; i < num_words && status == 0; i++) {
+            size_t size = (size_t)(offsets[i + 1] - offsets[i]);
+            if (fwrite(sorted[i].word, 1, size, fp) != size) {
+                status = -1;
+            }
+        }
+        if (fclose(fp) == EOF) {
+            status = -1;
+        }
+        if (status == 0 && rename(temp_path, path) == -1) {
+            status = -1;
+        }
+        if (status == -1) {
+            unlink(temp_path);
+        }
+    }
+
+    free(sorted);
+    free(offsets);
+    free(counts);
+    free(rank_entries);
+    free(ranks);
+    free(directory);
+    return status;
+}
+
+/* Map an index read-only and check its layout. Returns 0, or -1 with errno set. */
+int count_index_open(CountIndex *index, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(CountIndexHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    index->size = (size_t)st.st_size;
+    index->block = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index->block == MAP_FAILED) {
+        return -1;
+    }
+
+    /* The sections must follow each other inside the file, so no sum below can wrap */
+    const CountIndexHeader *header = index->block;
+    uint64_t n = header->num_words;
+    if (memcmp(header->magic, COUNT_INDEX_MAGIC, sizeof(header->magic)) != 0 || header->file_size != index->size ||
+        n >= UINT32_MAX || header->directory_size == 0 || (header->directory_size & (header->directory_size - 1)) ||
+        header->directory_size <= n || header->directory_size > index->size / sizeof(uint32_t) ||
+        header->offsets_offset != ALIGN8(sizeof(CountIndexHeader)) || header->counts_offset % 8 != 0 ||
+        header->ranks_offset % 8 != 0 || header->directory_offset % 8 != 0 || header->pool_offset > index->size ||
+        header->counts_offset > header->pool_offset || header->ranks_offset > header->pool_offset ||
+        header->directory_offset > header->pool_offset ||
+        header->offsets_offset + (n + 1) * sizeof(uint64_t) > header->counts_offset ||
+        header->counts_offset + n * sizeof(uint64_t) > header->ranks_offset ||
+        header->ranks_offset + n * sizeof(uint32_t) > header->directory_offset ||
+        header->directory_offset + header->directory_size * sizeof(uint32_t) > header->pool_offset ||
+        header->pool_offset + header->pool_size != header->file_size) {
+        munmap((void *)index->block, index->size);
+        errno = EINVAL;
+        return -1;
+    }
+    const char *base = index->block;
+    index->header = header;
+    index->offsets = (const uint64_t *)(base + header->offsets_offset);
+    index->counts = (const uint64_t *)(base + header->counts_offset);
+    index->ranks = (const uint32_t *)(base + header->ranks_offset);
+    index->directory = (const uint32_t *)(base + header->directory_offset);
+    index->pool = base + header->pool_offset;
+    /* Every offset, rank and directory entry is used as an index without further checks */
+    int valid = index->offsets[0] == 0 && index->offsets[n] == header->pool_size;
+    for (uint64_t i = 0; valid && i < n; i++) {
+        valid = index->offsets[i] < index->offsets[i + 1] && index->ranks[i] < n;
+    }
+    for (uint64_t slot = 0; valid && slot < header->directory_size; slot++) {
+        valid = index->directory[slot] <= n;
+    }
+    if (!valid) {
+        munmap((void *)index->block, index->size);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* The i-th word in sorted order, '\0'-terminated */
+const char *count_index_word(const CountIndex *index, size_t i, size_t *length) {
+    *length = (size_t)(index->offsets[i + 1] - index->offsets[i] - 1);
+    return index->pool + index->offsets[i];
+}
+
+/* Look a word up through the hash directory. Returns 1 with its position, or 0. */
+int count_index_find(const CountIndex *index, const char *word, size_t length, size_t *position) {
+    uint64_t mask = index->header->directory_size - 1;
+    uint64_t slot = word_hash(word, length) & mask;
+    for (uint64_t probes = 0; probes <= mask && index->directory[slot]; probes++) {
+        size_t i = index->directory[slot] - 1;
+        size_t stored_length;
+        const char *stored = count_index_word(index, i, &stored_length);
+        if (stored_length == length && memcmp(stored, word, length) == 0) {
+            *position = i;
+            return 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return 0;
+}
+
+/* Position of the first word not below the given one, for prefix scans */
+size_t count_index_lower_bound(const CountIndex *index, const char *word, size_t length) {
+    size_t low = 0, high = (size_t)index->header->num_words;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        size_t stored_length;
+        const char *stored = count_index_word(index, middle, &stored_length);
+        size_t common = stored_length < length ? stored_length : length;
+        int order = memcmp(stored, word, common);
+        if (order < 0 || (order == 0 && stored_length < length)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void count_index_close(CountIndex *index) {
+    munmap((void *)index->block, index->size);
+    index->block = NULL;
+}
@@ -0,0 +1,67 @@
+/* count_index.h */
+
+#ifndef COUNT_INDEX_H
+#define COUNT_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_table.h"
+
+/*
+ * Binary index of a whole vocabulary, written by lexan --index FILE and read
+ * by lexquery through mmap. All sections are 8-byte aligned and hold integers
+ * in the byte order of the machine that wrote them:
+ *
+ *   [CountIndexHeader]
+ *   [u64 offsets x (num_words + 1)]   word i is pool[offsets[i], offsets[i + 1] - 1)
+ *   [u64 counts x num_words]
+ *   [u32 ranks x num_words]           word indices by descending count, ties by word
+ *   [u32 directory x directory_size]  word index + 1 at the slot of its word_hash
+ *                                     (linear probing), 0 for an empty slot
+ *   [pool]                            the words in ascending byte order, each
+ *                                     followed by '\0'
+ *
+ * Words are sorted, so prefix scans are a binary search followed by a walk;
+ * point lookups go through the hash directory, and the top k are the first
+ * k ranks.
+ */
+
+#define COUNT_INDEX_MAGIC "LXINDEX1"
+
+typedef struct CountIndexHeader {
+    char magic[8];
+    uint64_t num_words;
+    uint64_t total_count;       /* non-excluded words of the run, as in lexan's output */
+    uint64_t directory_size;    /* a power of two */
+    uint64_t offsets_offset;
+    uint64_t counts_offset;
+    uint64_t ranks_offset;
+    uint64_t directory_offset;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+    uint64_t file_size;
+} CountIndexHeader;
+
+/* A mapped index */
+typedef struct CountIndex {
+    const void *block;
+    size_t size;
+    const CountIndexHeader *header;
+    const uint64_t *offsets;
+    const uint64_t *counts;
+    const uint32_t *ranks;
+    const uint32_t *directory;
+    const char *pool;
+} CountIndex;
+
+/* Writer Functions */
+int count_index_write(const char *path, const WordCount *words, size_t num_words, uint64_t total_count);
+
+/* Reader Functions */
+int count_index_open(CountIndex *index, const char *path);
+const char *count_index_word(const CountIndex *index, size_t i, size_t *length);
+int count_index_find(const CountIndex *index, const char *word, size_t length, size_t *position);
+size_t count_index_lower_bound(const CountIndex *index, const char *word, size_t length);
+void count_index_close(CountIndex *index);
+
+#endif
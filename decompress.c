@@ -0,0 +1,388 @@
+/* decompress.c */
+
+#include "decompress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define ZSTD_FRAME_MAGIC 0xFD2FB528u
+#define ZSTD_SKIPPABLE_MASK 0xFFFFFFF0u
+#define ZSTD_SKIPPABLE_MAGIC 0x184D2A50u
+
+static uint32_t read_le(const unsigned char *bytes, int size) {
+    uint32_t value = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+/* Read exactly size bytes at offset. Returns 0, or -1 on error or end of file. */
+static int read_at(int fd, void *buffer, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, (char *)buffer + done, size - done, offset + (off_t)done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/* Tell compressed files by their magic number; anything unreadable is plain */
+InputFormat input_format(int fd) {
+    unsigned char magic[4];
+    if (read_at(fd, magic, sizeof(magic), 0) == -1) {
+        return INPUT_PLAIN;
+    }
+    if (magic[0] == 0x1f && magic[1] == 0x8b) {
+        return INPUT_GZIP;
+    }
+    if (read_le(magic, 4) == ZSTD_FRAME_MAGIC) {
+        return INPUT_ZSTD;
+    }
+    return INPUT_PLAIN;
+}
+
+int input_format_supported(InputFormat format) {
+#ifdef HAVE_ZSTD
+    (void)format;
+    return 1;
+#else
+    return format != INPUT_ZSTD;
+#endif
+}
+
+/* Size of the BGZF member at offset (the BC subfield of its header), or -1
+ * if the member is not BGZF */
+static off_t bgzf_member_size(int fd, off_t offset) {
+    unsigned char header[12];
+    if (read_at(fd, header, sizeof(header), offset) == -1 || header[0] != 0x1f || header[1] != 0x8b ||
+        header[2] != 8 || !(header[3] & 4)) {
+        return -1;
+    }
+    size_t extra_length = read_le(header + 10, 2);
+    unsigned char extra[65536];
+    if (read_at(fd, extra, extra_length, offset + 12) == -1) {
+        return -1;
+    }
+    for (size_t i = 0; i + 4 <= extra_length;) {
+        size_t field_length = read_le(extra + i + 2, 2);
+        if (extra[i] == 'B' && extra[i + 1] == 'C' && field_length == 2 && i + 6 <= extra_length) {
+            return (off_t)read_le(extra + i + 4, 2) + 1;
+        }
+        i += 4 + field_length;
+    }
+    return -1;
+}
+
+/* Size of the zstd frame at offset, found by walking its block headers, or -1 */
+static off_t zstd_frame_size(int fd, off_t offset) {
+    unsigned char header[8];
+    if (read_at(fd, header, 4, offset) == -1) {
+        return -1;
+    }
+    uint32_t magic = read_le(header, 4);
+    if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+        if (read_at(fd, header + 4, 4, offset + 4) == -1) {
+            return -1;
+        }
+        return 8 + (off_t)read_le(header + 4, 4);
+    }
+    if (magic != ZSTD_FRAME_MAGIC || read_at(fd, header, 1, offset + 4) == -1) {
+        return -1;
+    }
+
+    // Frame header: descriptor, window descriptor, dictionary id, content size
+    static const int dictionary_sizes[4] = { 0, 1, 2, 4 };
+    static const int content_sizes[4] = { 0, 2, 4, 8 };
+    unsigned char descriptor = header[0];
+    int single_segment = (descriptor >> 5) & 1;
+    int content_size_flag = descriptor >> 6;
+    off_t position = offset + 5 + !single_segment + dictionary_sizes[descriptor & 3] +
+                     (content_size_flag == 0 ? single_segment : content_sizes[content_size_flag]);
+
+    for (;;) {
+        unsigned char block[3];
+        if (read_at(fd, block, sizeof(block), position) == -1) {
+            return -1;
+        }
+        uint32_t block_header = read_le(block, 3);
+        int last = block_header & 1;
+        int type = (block_header >> 1) & 3;
+        uint32_t block_size = block_header >> 3;
+        if (type == 3) {
+            return -1;
+        }
+        position += 3 + (type == 1 ? 1 : (off_t)block_size);
+        if (last) {
+            break;
+        }
+    }
+    if (descriptor & 4) {
+        position += 4;          /* content checksum */
+    }
+    return position - offset;
+}
+
+/* Cut a compressed file into parts of at least target bytes that start at
+ * member or frame boundaries. A file whose members cannot be found without
+ * decompressing it is a single part. Returns 0 with the parts in arrays the
+ * caller frees. */
+int compressed_splits(int fd, InputFormat format, off_t size, off_t target, off_t **offsets, off_t **lengths,
+                      size_t *num_parts) {
+    size_t capacity = 16, parts = 0;
+    *offsets = malloc(capacity * sizeof(off_t));
+    *lengths = malloc(capacity * sizeof(off_t));
+    if (!*offsets || !*lengths) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    off_t start = 0, position = 0;
+    while (position < size) {
+        off_t member = format == INPUT_GZIP ? bgzf_member_size(fd, position) : zstd_frame_size(fd, position);
+        if (member <= 0 || position + member > size) {
+            // Not BGZF, or damaged: leave it whole to the decompressor
+            parts = 0;
+            break;
+        }
+        position += member;
+        if (position - start >= target || position == size) {
+            if (parts >= capacity) {
+                capacity *= 2;
+                off_t *new_offsets = realloc(*offsets, capacity * sizeof(off_t));
+                off_t *new_lengths = realloc(*lengths, capacity * sizeof(off_t));
+                if (!new_offsets || !new_lengths) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+                *offsets = new_offsets;
+                *lengths = new_lengths;
+            }
+            (*offsets)[parts] = start;
+            (*lengths)[parts] = position - start;
+            parts++;
+            start = position;
+        }
+    }
+    if (parts == 0) {
+        (*offsets)[0] = 0;
+        (*lengths)[0] = size;
+        parts = 1;
+    }
+    *num_parts = parts;
+    return 0;
+}
+
+/* Where a chunk of a compressed file meets its neighbours. Members and frames
+ * are cut without regard to words, so a chunk that does not start the file
+ * skips everything up to and including its first delimiter, and a chunk that
+ * does not end the file reads on into the following members up to and
+ * including the first delimiter there. Every word is tokenized exactly once. */
+typedef struct RangeOutput {
+    Tokenizer *tokenizer;
+    token_callback emit;
+    void *context;
+    int skipping;               /* before the first delimiter of the range */
+    int extending;              /* past the end of the range */
+    int done;                   /* the delimiter after the range has been reached */
+} RangeOutput;
+
+static size_t find_delimiter(const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != '\0' && strchr(WORD_DELIMITERS, data[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+static void feed_output(RangeOutput *output, const char *data, size_t size) {
+    if (output->skipping) {
+        size_t delimiter = find_delimiter(data, size);
+        if (delimiter == size) {
+            return;
+        }
+        output->skipping = 0;
+        if (output->extending) {
+            output->done = 1;
+            return;
+        }
+        data += delimiter + 1;
+        size -= delimiter + 1;
+    }
+    if (output->extending) {
+        size_t delimiter = find_delimiter(data, size);
+        if (delimiter < size) {
+            size = delimiter + 1;
+            output->done = 1;
+        }
+    }
+    tokenizer_feed(output->tokenizer, data, size, output->emit, output->context);
+}
+
+/* Read the next slice of compressed input into buffer. Returns the number
+ * of bytes, 0 once *remaining is exhausted, or -1. */
+static ssize_t read_compressed(int fd, unsigned char *buffer, off_t *position, off_t *remaining) {
+    if (*remaining == 0) {
+        return 0;
+    }
+    size_t size = *remaining < DECOMPRESS_IN_SIZE ? (size_t)*remaining : DECOMPRESS_IN_SIZE;
+    ssize_t n;
+    do {
+        n = pread(fd, buffer, size, *position);
+    } while (n == -1 && errno == EINTR);
+    if (n == 0) {
+        errno = EIO;            /* the file shrank */
+        return -1;
+    }
+    if (n > 0) {
+        *position += n;
+        *remaining -= n;
+    }
+    return n;
+}
+
+/* Inflate every gzip member from offset on: the range, then the extension */
+static int tokenize_gzip(int fd, off_t offset, off_t length, off_t file_size, unsigned char *in,
+                         unsigned char *out, RangeOutput *output, const int *stop) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+        fprintf(stderr, "Error: Could not initialize zlib.\n");
+        return -1;
+    }
+    int status = 0;
+    while (!*stop && !output->done) {
+        if (stream.avail_in == 0) {
+            ssize_t n = read_compressed(fd, in, &offset, &length);
+            if (n == -1) {
+                perror("read compressed input");
+                status = -1;
+                break;
+            }
+            stream.next_in = in;
+            stream.avail_in = (uInt)n;
+        }
+        stream.next_out = out;
+        stream.avail_out = DECOMPRESS_OUT_SIZE;
+        int result = inflate(&stream, Z_NO_FLUSH);
+        feed_output(output, (const char *)out, DECOMPRESS_OUT_SIZE - stream.avail_out);
+        if (result == Z_STREAM_END) {
+            if (stream.avail_in == 0 && length == 0) {
+                if (output->extending || offset >= file_size) {
+                    break;
+                }
+                output->extending = 1;
+                length = file_size - offset;
+            }
+            inflateReset(&stream);          /* the next member */
+        } else if (result == Z_BUF_ERROR && stream.avail_in == 0 && length == 0) {
+            fprintf(stderr, "Error: Truncated gzip input.\n");
+            status = -1;
+            break;
+        } else if (result != Z_OK && result != Z_BUF_ERROR) {
+            fprintf(stderr, "Error: Corrupt gzip input: %s\n", stream.msg ? stream.msg : "unknown error");
+            status = -1;
+            break;
+        }
+    }
+    inflateEnd(&stream);
+    return status;
+}
+
+#ifdef HAVE_ZSTD
+/* Decompress every zstd frame from offset on; skippable frames are passed over */
+static int tokenize_zstd(int fd, off_t offset, off_t length, off_t file_size, unsigned char *in,
+                         unsigned char *out, RangeOutput *output, const int *stop) {
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    if (!stream) {
+        fprintf(stderr, "Error: Could not initialize zstd.\n");
+        return -1;
+    }
+    ZSTD_initDStream(stream);
+    ZSTD_inBuffer input = { in, 0, 0 };
+    int status = 0;
+    while (!*stop && !output->done) {
+        if (input.pos == input.size) {
+            ssize_t n = read_compressed(fd, in, &offset, &length);
+            if (n == -1) {
+                perror("read compressed input");
+                status = -1;
+                break;
+            }
+            input.size = (size_t)n;
+            input.pos = 0;
+        }
+        ZSTD_outBuffer decoded = { out, DECOMPRESS_OUT_SIZE, 0 };
+        size_t pending = ZSTD_decompressStream(stream, &decoded, &input);
+        if (ZSTD_isError(pending)) {
+            fprintf(stderr, "Error: Corrupt zstd input: %s\n", ZSTD_getErrorName(pending));
+            status = -1;
+            break;
+        }
+        feed_output(output, (const char *)out, decoded.pos);
+        if (input.pos == input.size && length == 0 && decoded.pos < decoded.size) {
+            if (pending != 0) {
+                fprintf(stderr, "Error: Truncated zstd input.\n");
+                status = -1;
+                break;
+            }
+            if (output->extending || offset >= file_size) {
+                break;
+            }
+            output->extending = 1;
+            length = file_size - offset;
+        }
+    }
+    ZSTD_freeDStream(stream);
+    return status;
+}
+#endif
+
+/* Decompress [offset, offset + length) of a gzip or zstd file, which starts
+ * and ends at member or frame boundaries, into the tokenizer */
+int tokenize_compressed(int fd, InputFormat format, off_t offset, off_t length, Tokenizer *tokenizer,
+                        token_callback emit, void *context, const int *stop) {
+    if (!input_format_supported(format)) {
+        fprintf(stderr, "Error: zstd input needs a build with HAVE_ZSTD.\n");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat input_file");
+        return -1;
+    }
+    unsigned char *in = malloc(DECOMPRESS_IN_SIZE);
+    unsigned char *out = malloc(DECOMPRESS_OUT_SIZE);
+    if (!in || !out) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    RangeOutput output = { tokenizer, emit, context, offset > 0, 0, 0 };
+    int status;
+#ifdef HAVE_ZSTD
+    if (format == INPUT_ZSTD) {
+        status = tokenize_zstd(fd, offset, length, st.st_size, in, out, &output, stop);
+    } else
+#endif
+    {
+        status = tokenize_gzip(fd, offset, length, st.st_size, in, out, &output, stop);
+    }
+    free(in);
+    free(out);
+    return status;
+}
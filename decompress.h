@@ -0,0 +1,42 @@
+/* decompress.h */
+
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "tokenizer.h"
+
+/*
+ * Compressed inputs. A file that starts with the gzip or zstd magic is
+ * decompressed in windows of DECOMPRESS_OUT_SIZE bytes straight into the
+ * tokenizer, so nothing is ever written to disk.
+ *
+ * A compressed file can only be cut where a gzip member or a zstd frame
+ * starts. BGZF files (bgzip) record every member's size in its header, and
+ * zstd frames can be walked block by block without decompressing them, so
+ * lexan groups their members or frames into chunks that different splitters
+ * decompress in parallel. Any other gzip file is a single chunk; it may
+ * still hold several members, which are read one after the other.
+ *
+ * zstd needs libzstd: build with make HAVE_ZSTD=1.
+ */
+
+#define DECOMPRESS_IN_SIZE (256 * 1024)
+#define DECOMPRESS_OUT_SIZE (1024 * 1024)
+
+typedef enum InputFormat {
+    INPUT_PLAIN,
+    INPUT_GZIP,
+    INPUT_ZSTD
+} InputFormat;
+
+/* Decompress Functions */
+InputFormat input_format(int fd);
+int input_format_supported(InputFormat format);
+int compressed_splits(int fd, InputFormat format, off_t size, off_t target, off_t **offsets, off_t **lengths,
+                      size_t *num_parts);
+int tokenize_compressed(int fd, InputFormat format, off_t offset, off_t length, Tokenizer *tokenizer,
+                        token_callback emit, void *context, const int *stop);
+
+#endif
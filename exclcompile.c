@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "exclusion_set.h"
+
+/* Compile a whitespace-separated exclusion list into the binary lookup
+ * file that splitters map directly (see exclusion_set.h) */
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <exclusion_list> <compiled_output>\n", argv[0]);
+        return 1;
+    }
+
+    ExclusionSet set;
+    if (exclusion_set_build(&set, argv[1]) == -1) {
+        fprintf(stderr, "Error: Could not read exclusion list '%s'.\n", argv[1]);
+        return 1;
+    }
+
+    const ExclusionSetHeader *header = set.block;
+    if (exclusion_set_write(&set, argv[2]) == -1) {
+        exclusion_set_free(&set);
+        return 1;
+    }
+    printf("Compiled %u words into %zu bytes (%llu slots).\n", header->num_words, set.size,
+           (unsigned long long)header->num_slots);
+
+    exclusion_set_free(&set);
+    return 0;
+}
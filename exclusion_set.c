@@ -0,0 +1,302 @@
+/* exclusion_set.c */
+
+#include "exclusion_set.h"
+#include "hash_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Read the whole exclusion file into a '\0'-terminated buffer */
+static char *read_whole_file(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror("fopen exclusion_file");
+        return NULL;
+    }
+    size_t capacity = 4096, used = 0;
+    char *data = malloc(capacity);
+    if (!data) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t n;
+    while ((n = fread(data + used, 1, capacity - used - 1, fp)) > 0) {
+        used += n;
+        if (capacity - used - 1 == 0) {
+            capacity *= 2;
+            char *temp = realloc(data, capacity);
+            if (!temp) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            data = temp;
+        }
+    }
+    if (ferror(fp)) {
+        perror("fread exclusion_file");
+        fclose(fp);
+        free(data);
+        return NULL;
+    }
+    fclose(fp);
+    data[used] = '\0';
+    *size = used;
+    return data;
+}
+
+/* Point the lookup fields of the set at its block */
+static void exclusion_set_attach(ExclusionSet *set, void *block, size_t size) {
+    const ExclusionSetHeader *header = block;
+    set->block = block;
+    set->size = size;
+    set->mapped = 0;
+    set->slots = (const ExclusionSlot *)((const char *)block + header->slots_offset);
+    set->pool = (const char *)block + header->pool_offset;
+    set->mask = header->num_slots - 1;
+}
+
+/* Build the set from a text file of whitespace-separated words */
+int exclusion_set_build(ExclusionSet *set, const char *path) {
+    size_t text_size;
+    char *text = read_whole_file(path, &text_size);
+    if (!text) {
+        return -1;
+    }
+
+    /* Split the text in place and count the words */
+    size_t num_words = 0;
+    for (size_t i = 0; i < text_size; i++) {
+        if (isspace((unsigned char)text[i])) {
+            text[i] = '\0';
+        } else if (i == 0 || text[i - 1] == '\0') {
+            num_words++;
+        }
+    }
+
+    uint64_t num_slots = 16;
+    while (num_slots < 2 * (uint64_t)num_words) {
+        num_slots *= 2;
+    }
+
+    size_t slots_offset = sizeof(ExclusionSetHeader);
+    size_t pool_offset = slots_offset + num_slots * sizeof(ExclusionSlot);
+    size_t total_size = pool_offset + text_size + 1;
+    char *block = calloc(1, total_size);
+    if (!block) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    ExclusionSetHeader *header = (ExclusionSetHeader *)block;
+    memcpy(header->magic, EXCLUSION_SET_MAGIC, sizeof(header->magic));
+    header->version = EXCLUSION_SET_VERSION;
+    header->num_slots = num_slots;
+    header->slots_offset = slots_offset;
+    header->pool_offset = pool_offset;
+    header->total_size = total_size;
+
+    ExclusionSlot *slots = (ExclusionSlot *)(block + slots_offset);
+    char *pool = block + pool_offset;
+    for (uint64_t i = 0; i < num_slots; i++) {
+        slots[i].length = EXCLUSION_SLOT_EMPTY;
+    }
+
+    /* Insert every distinct word, copying it into the pool */
+    size_t pool_used = 0;
+    uint64_t mask = num_slots - 1;
+    for (size_t i = 0; i < text_size; i++) {
+        if (text[i] == '\0' || (i > 0 && text[i - 1] != '\0')) {
+            continue;
+        }
+        const char *word = text + i;
+        size_t length = strlen(word);
+        uint64_t hash = word_hash(word, length);
+        uint64_t index = hash & mask;
+        int duplicate = 0;
+        while (slots[index].length != EXCLUSION_SLOT_EMPTY) {
+            if (slots[index].hash == hash && slots[index].length == length &&
+                memcmp(pool + slots[index].offset, word, length) == 0) {
+                duplicate = 1;
+                break;
+            }
+            index = (index + 1) & mask;
+        }
+        if (duplicate) {
+            continue;
+        }
+        slots[index].hash = hash;
+        slots[index].offset = (uint32_t)pool_used;
+        slots[index].length = (uint32_t)length;
+        memcpy(pool + pool_used, word, length + 1);
+        pool_used += length + 1;
+        header->num_words++;
+    }
+    free(text);
+
+    exclusion_set_attach(set, block, total_size);
+    return 0;
+}
+
+/* Check whether a file starts with the compiled set magic */
+int exclusion_set_is_compiled(const char *path) {
+    char magic[sizeof(((ExclusionSetHeader *)0)->magic)];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+    size_t n = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+    return n == sizeof(magic) && memcmp(magic, EXCLUSION_SET_MAGIC, sizeof(magic)) == 0;
+}
+
+/* Map a compiled set read-only; all processes mapping the file share its pages */
+int exclusion_set_map(ExclusionSet *set, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open exclusion_file");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat exclusion_file");
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(ExclusionSetHeader)) {
+        fprintf(stderr, "Compiled exclusion file '%s' is truncated.\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *block = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (block == MAP_FAILED) {
+        perror("mmap exclusion_file");
+        return -1;
+    }
+
+    /* Validate the header before trusting any offset in it */
+    const ExclusionSetHeader *header = block;
+    uint64_t num_slots = header->num_slots;
+    if (memcmp(header->magic, EXCLUSION_SET_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version != EXCLUSION_SET_VERSION) {
+        fprintf(stderr, "Compiled exclusion file '%s' has version %u, expected %u; compile it again with exclcompile.\n",
+                path, header->version, EXCLUSION_SET_VERSION);
+        munmap(block, size);
+        return -1;
+    }
+    if (memcmp(header->magic, EXCLUSION_SET_MAGIC, sizeof(header->magic)) != 0 ||
+        header->total_size != size || num_slots == 0 || (num_slots & (num_slots - 1)) != 0 ||
+        num_slots > size / sizeof(ExclusionSlot) || header->num_words >= num_slots ||
+        header->slots_offset != sizeof(ExclusionSetHeader) ||
+        header->pool_offset != header->slots_offset + num_slots * sizeof(ExclusionSlot) ||
+        header->pool_offset > size) {
+        fprintf(stderr, "Compiled exclusion file '%s' is corrupt.\n", path);
+        munmap(block, size);
+        return -1;
+    }
+
+    /* Then every used slot: its word must lie inside the pool, and at least one
+     * slot must stay empty or a lookup of a missing word would never end */
+    const ExclusionSlot *slots = (const ExclusionSlot *)((const char *)block + header->slots_offset);
+    uint64_t pool_size = size - header->pool_offset;
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < num_slots; i++) {
+        if (slots[i].length == EXCLUSION_SLOT_EMPTY) {
+            continue;
+        }
+        if ((uint64_t)slots[i].offset + slots[i].length > pool_size) {
+            break;
+        }
+        used++;
+    }
+    if (used != header->num_words) {
+        fprintf(stderr, "Compiled exclusion file '%s' is corrupt.\n", path);
+        munmap(block, size);
+        return -1;
+    }
+    madvise(block, size, MADV_WILLNEED);
+
+    exclusion_set_attach(set, block, size);
+    set->mapped = 1;
+    return 0;
+}
+
+/* Map the file if it is a compiled set, otherwise build the set from the word list */
+int exclusion_set_load(ExclusionSet *set, const char *path) {
+    if (exclusion_set_is_compiled(path)) {
+        return exclusion_set_map(set, path);
+    }
+    return exclusion_set_build(set, path);
+}
+
+/* Write the set's block to an open file descriptor */
+int exclusion_set_write_fd(const ExclusionSet *set, int fd) {
+    const char *data = set->block;
+    size_t done = 0;
+    while (done < set->size) {
+        ssize_t n = write(fd, data + done, set->size - done);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/* Write the set to a file that can later be mapped with exclusion_set_map */
+int exclusion_set_write(const ExclusionSet *set, const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("open compiled exclusion file");
+        return -1;
+    }
+    if (exclusion_set_write_fd(set, fd) == -1) {
+        perror("write compiled exclusion file");
+        close(fd);
+        return -1;
+    }
+    if (close(fd) == -1) {
+        perror("close compiled exclusion file");
+        return -1;
+    }
+    return 0;
+}
+
+/* Check whether a word of the given length is excluded */
+int exclusion_set_contains(const ExclusionSet *set, const char *word, size_t length) {
+    uint64_t hash = word_hash(word, length);
+    uint64_t index = hash & set->mask;
+    for (;;) {
+        const ExclusionSlot *slot = &set->slots[index];
+        if (slot->length == EXCLUSION_SLOT_EMPTY) {
+            return 0;
+        }
+        if (slot->hash == hash && slot->length == length &&
+            memcmp(set->pool + slot->offset, word, length) == 0) {
+            return 1;
+        }
+        index = (index + 1) & set->mask;
+    }
+}
+
+/* Release the set */
+void exclusion_set_free(ExclusionSet *set) {
+    if (set->mapped) {
+        munmap(set->block, set->size);
+    } else {
+        free(set->block);
+    }
+    set->block = NULL;
+    set->slots = NULL;
+    set->pool = NULL;
+    set->size = 0;
+}
@@ -0,0 +1,64 @@
+/* exclusion_set.h */
+
+#ifndef EXCLUSION_SET_H
+#define EXCLUSION_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Read-only set of excluded words, built once and probed for every token.
+ *
+ * The set is a single flat block that only uses offsets, laid out as
+ *   [ExclusionSetHeader][ExclusionSlot x num_slots][word pool]
+ * Slots form an open-addressing table (linear probing, load <= 1/2) that
+ * stores the full word hash, so almost every miss ends at an empty slot
+ * without comparing any bytes.
+ *
+ * Because the block is position independent it can be written to a file
+ * (see exclcompile) and mapped read-only by every splitter, which then
+ * share the same physical pages. The slots are only valid for the word_hash
+ * they were built with, so the header carries a version that must change
+ * whenever the layout or the hash function does.
+ */
+
+#define EXCLUSION_SET_MAGIC "LXEXCL01"
+#define EXCLUSION_SET_VERSION 1
+#define EXCLUSION_SLOT_EMPTY UINT32_MAX
+
+typedef struct ExclusionSetHeader {
+    char magic[8];
+    uint32_t num_words;         /* < num_slots, so every probe ends */
+    uint32_t version;           /* EXCLUSION_SET_VERSION */
+    uint64_t num_slots;         /* power of two */
+    uint64_t slots_offset;      /* from the start of the block */
+    uint64_t pool_offset;
+    uint64_t total_size;
+} ExclusionSetHeader;
+
+typedef struct ExclusionSlot {
+    uint64_t hash;
+    uint32_t offset;            /* into the word pool */
+    uint32_t length;            /* EXCLUSION_SLOT_EMPTY for an unused slot */
+} ExclusionSlot;
+
+typedef struct ExclusionSet {
+    void *block;
+    size_t size;
+    int mapped;                 /* block comes from mmap rather than malloc */
+    const ExclusionSlot *slots;
+    const char *pool;
+    uint64_t mask;
+} ExclusionSet;
+
+/* Exclusion Set Functions */
+int exclusion_set_build(ExclusionSet *set, const char *path);
+int exclusion_set_is_compiled(const char *path);
+int exclusion_set_map(ExclusionSet *set, const char *path);
+int exclusion_set_load(ExclusionSet *set, const char *path);
+int exclusion_set_write_fd(const ExclusionSet *set, int fd);
+int exclusion_set_write(const ExclusionSet *set, const char *path);
+int exclusion_set_contains(const ExclusionSet *set, const char *word, size_t length);
+void exclusion_set_free(ExclusionSet *set);
+
+#endif
@@ -5,12 +5,105 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* Hash function */
-unsigned int hash_function(const char *str, int table_size) {
-    unsigned int hash = 0;
-    while (*str)
-        hash = (hash << 5) + (unsigned char)(*str++);
-    return hash % table_size;
+/* wyhash (final version 4) constants and helpers */
+static const uint64_t wyp[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+static inline void wymum(uint64_t *a, uint64_t *b) {
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wyr8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t wyr4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t wyr3(const uint8_t *p, size_t k) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+/* 64-bit wyhash of a word of known length */
+uint64_t word_hash(const char *word, size_t length) {
+    const uint8_t *p = (const uint8_t *)word;
+    uint64_t seed = wymix(wyp[0], wyp[1]);
+    uint64_t a, b;
+
+    if (length <= 16) {
+        if (length >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((length >> 3) << 2));
+            b = (wyr4(p + length - 4) << 32) | wyr4(p + length - 4 - ((length >> 3) << 2));
+        } else if (length > 0) {
+            a = wyr3(p, length);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = length;
+        if (i >= 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+
+    a ^= wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ wyp[0] ^ length, b ^ wyp[1]);
+}
+
+/* Map a word hash to one of num_partitions owners.
+ * The high 32 bits are used so that the owner choice stays independent
+ * of the low bits that pick the slot inside the owner's table. */
+int partition_for_hash(uint64_t hash, int num_partitions) {
+    return (int)(((hash >> 32) * (uint64_t)num_partitions) >> 32);
+}
+
+/* 7-bit tag stored in the metadata byte; taken from bits that neither the
+ * slot index nor partition_for_hash depend on for realistic sizes */
+static inline uint8_t hash_tag(uint64_t hash) {
+    return (uint8_t)((hash >> 25) & 0x7F);
+}
+
+/* Allocate the metadata and slot arrays for a table of the given size */
+static void allocate_slots(HashTable *table, size_t size) {
+    table->ctrl = malloc(size);
+    table->slots = malloc(size * sizeof(HashSlot));
+    if (!table->ctrl || !table->slots) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(table->ctrl, HASH_SLOT_EMPTY, size);
+    table->size = size;
 }
 
 /* Create a new hash table */
@@ -20,99 +113,164 @@ HashTable* create_hash_table(void) {
         perror("malloc");
         exit(EXIT_FAILURE);
     }
-    table->size = INITIAL_HASH_SIZE;
+    allocate_slots(table, INITIAL_HASH_SIZE);
     table->count = 0;
-    table->buckets = calloc(table->size, sizeof(WordCount *));
-    if (!table->buckets) {
-        perror("calloc");
-        free(table);
-        exit(EXIT_FAILURE);
-    }
+    table->resizes = 0;
+    arena_init(&table->keys, ARENA_BLOCK_SIZE);
     return table;
 }
 
 /* Resize the hash table */
 void resize_hash_table(HashTable *table) {
-    int new_size = table->size * 2;
-    WordCount **new_buckets = calloc(new_size, sizeof(WordCount *));
-    if (!new_buckets) {
-        perror("calloc");
-        exit(EXIT_FAILURE);
-    }
+    uint8_t *old_ctrl = table->ctrl;
+    HashSlot *old_slots = table->slots;
+    size_t old_size = table->size;
+
+    allocate_slots(table, old_size * 2);
+    table->resizes++;
+    size_t mask = table->size - 1;
 
-    /* Rehash all existing entries */
-    for (int i = 0; i < table->size; i++) {
-        WordCount *node = table->buckets[i];
-        while (node) {
-            WordCount *next = node->next;
-            unsigned int hash = hash_function(node->word, new_size);
-            node->next = new_buckets[hash];
-            new_buckets[hash] = node;
-            node = next;
+    /* Re-place all existing entries using their stored hashes */
+    for (size_t i = 0; i < old_size; i++) {
+        if (old_ctrl[i] == HASH_SLOT_EMPTY) {
+            continue;
         }
+        size_t index = old_slots[i].hash & mask;
+        while (table->ctrl[index] != HASH_SLOT_EMPTY) {
+            index = (index + 1) & mask;
+        }
+        table->ctrl[index] = old_ctrl[i];
+        table->slots[index] = old_slots[i];
     }
 
-    free(table->buckets);
-    table->buckets = new_buckets;
-    table->size = new_size;
+    free(old_ctrl);
+    free(old_slots);
 }
 
-/* Insert or update a word in the hash table */
-void insert_or_update_word(HashTable *table, const char *word, int count) {
-    if ((double)table->count / table->size > LOAD_FACTOR_THRESHOLD) {
+/* Insert or update a word of known length in the hash table */
+void insert_or_update_word_n(HashTable *table, const char *word, size_t length, uint64_t count) {
+    if ((double)(table->count + 1) / table->size > LOAD_FACTOR_THRESHOLD) {
         resize_hash_table(table);
     }
 
-    unsigned int hash = hash_function(word, table->size);
-    WordCount *node = table->buckets[hash];
-    while (node) {
-        if (strcmp(node->word, word) == 0) {
-            node->count += count;
+    uint64_t hash = word_hash(word, length);
+    uint8_t tag = hash_tag(hash);
+    size_t mask = table->size - 1;
+    size_t index = hash & mask;
+
+    /* Linear probing over the metadata bytes; the key is only compared
+     * when both the tag and the full stored hash match */
+    while (table->ctrl[index] != HASH_SLOT_EMPTY) {
+        HashSlot *slot = &table->slots[index];
+        if (table->ctrl[index] == tag && slot->hash == hash && slot->length == length &&
+            memcmp(slot->key, word, length) == 0) {
+            slot->count += count;
             return;
         }
-        node = node->next;
+        index = (index + 1) & mask;
     }
 
-    WordCount *new_node = malloc(sizeof(WordCount));
-    if (!new_node) {
-        perror("malloc");
-        exit(EXIT_FAILURE);
-    }
-    new_node->word = strdup(word);
-    if (!new_node->word) {
-        perror("strdup");
-        free(new_node);
-        exit(EXIT_FAILURE);
-    }
-    new_node->count = count;
-    new_node->next = table->buckets[hash];
-    table->buckets[hash] = new_node;
+    HashSlot *slot = &table->slots[index];
+    slot->hash = hash;
+    slot->key = arena_strndup(&table->keys, word, length);
+    slot->count = count;
+    slot->length = (uint32_t)length;
+    table->ctrl[index] = tag;
     table->count++;
 }
 
+/* Insert or update a word in the hash table */
+void insert_or_update_word(HashTable *table, const char *word, uint64_t count) {
+    insert_or_update_word_n(table, word, strlen(word), count);
+}
+
 /* Insert a word with count=1 */
 void insert_word(HashTable *table, const char *word) {
     insert_or_update_word(table, word, 1);
 }
 
-/* Free the hash table */
-void free_hash_table(HashTable *table) {
-    for (int i = 0; i < table->size; i++) {
-        WordCount *node = table->buckets[i];
-        while (node) {
-            WordCount *temp = node;
-            node = node->next;
-            free(temp->word);
-            free(temp);
+/* Look up a word of known length. Returns its slot, or NULL if the word is
+ * not in the table; the slot is only valid until the next insertion. */
+const HashSlot *hash_table_find(const HashTable *table, const char *word, size_t length) {
+    uint64_t hash = word_hash(word, length);
+    uint8_t tag = hash_tag(hash);
+    size_t mask = table->size - 1;
+    size_t index = hash & mask;
+
+    while (table->ctrl[index] != HASH_SLOT_EMPTY) {
+        const HashSlot *slot = &table->slots[index];
+        if (table->ctrl[index] == tag && slot->hash == hash && slot->length == length &&
+            memcmp(slot->key, word, length) == 0) {
+            return slot;
         }
+        index = (index + 1) & mask;
     }
-    free(table->buckets);
+    return NULL;
+}
+
+/* Iterate over the table: start with *position = 0 and call until it returns 0.
+ * The returned word is owned by the table and stays valid until it is freed. */
+int hash_table_next(const HashTable *table, size_t *position, WordCount *entry) {
+    for (size_t i = *position; i < table->size; i++) {
+        if (table->ctrl[i] != HASH_SLOT_EMPTY) {
+            entry->word = table->slots[i].key;
+            entry->count = table->slots[i].count;
+            *position = i + 1;
+            return 1;
+        }
+    }
+    *position = table->size;
+    return 0;
+}
+
+/* Bytes held by the table: slot arrays plus the key arena */
+size_t hash_table_memory(const HashTable *table) {
+    return sizeof(HashTable) + table->size * (sizeof(HashSlot) + 1) + table->keys.bytes_reserved;
+}
+
+/* Probe lengths of the current layout: how many slots a lookup of each stored
+ * word inspects. Measured from each slot's distance to its home slot, so the
+ * insert path does not have to count anything. */
+void hash_table_probe_stats(const HashTable *table, double *mean_probe, size_t *max_probe) {
+    size_t mask = table->size - 1;
+    uint64_t total = 0;
+    size_t longest = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        if (table->ctrl[i] == HASH_SLOT_EMPTY) {
+            continue;
+        }
+        size_t probe = ((i - (table->slots[i].hash & mask)) & mask) + 1;
+        total += probe;
+        if (probe > longest) {
+            longest = probe;
+        }
+    }
+    *mean_probe = table->count ? (double)total / table->count : 0;
+    *max_probe = longest;
+}
+
+/* Remove every entry but keep the slot arrays and one key block for reuse */
+void hash_table_clear(HashTable *table) {
+    memset(table->ctrl, HASH_SLOT_EMPTY, table->size);
+    table->count = 0;
+    arena_reset(&table->keys);
+}
+
+/* Free the hash table; keys are released a block at a time */
+void free_hash_table(HashTable *table) {
+    free(table->ctrl);
+    free(table->slots);
+    arena_free(&table->keys);
     free(table);
 }
 
-/* Comparison function for qsort */
+/* Comparison function for qsort: descending count, ties by ascending word.
+ * Counts are compared rather than subtracted so large counts cannot overflow. */
 int compare_counts(const void *a, const void *b) {
-    WordCount *wc1 = *(WordCount **)a;
-    WordCount *wc2 = *(WordCount **)b;
-    return wc2->count - wc1->count;
+    const WordCount *wc1 = a;
+    const WordCount *wc2 = b;
+    if (wc1->count != wc2->count) {
+        return wc1->count < wc2->count ? 1 : -1;
+    }
+    return strcmp(wc1->word, wc2->word);
 }
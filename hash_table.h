@@ -1,31 +1,58 @@
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
 
-
-
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
 
 #define INITIAL_HASH_SIZE 16
 #define LOAD_FACTOR_THRESHOLD 0.75
 
+/* Metadata byte of an unused slot; used slots hold a 7-bit tag of the hash */
+#define HASH_SLOT_EMPTY 0x80
 
+
+/* A (word, count) pair as returned by the table iterator */
 typedef struct WordCount {
-    char *word;
-    int count;
-    struct WordCount *next;
+    const char *word;
+    uint64_t count;
 } WordCount;
 
+/* One slot of the open-addressing table. The full hash is kept so that
+ * mismatches are rejected without touching the key, and resizing never
+ * has to rehash the words. */
+typedef struct HashSlot {
+    uint64_t hash;
+    const char *key;
+    uint64_t count;
+    uint32_t length;
+} HashSlot;
+
 typedef struct HashTable {
-    WordCount **buckets;
-    int size;
-    int count;
+    uint8_t *ctrl;          /* one metadata byte per slot, probed before the slot itself */
+    HashSlot *slots;
+    size_t size;            /* number of slots, always a power of two */
+    size_t count;
+    size_t resizes;         /* times the table has doubled */
+    Arena keys;             /* owns every key; freed block by block with the table */
 } HashTable;
 
 /* Hash Table Functions */
-unsigned int hash_function(const char *str, int table_size);
+uint64_t word_hash(const char *word, size_t length);
+int partition_for_hash(uint64_t hash, int num_partitions);
 HashTable* create_hash_table(void);
 void resize_hash_table(HashTable *table);
-void insert_or_update_word(HashTable *table, const char *word, int count);
+void insert_or_update_word(HashTable *table, const char *word, uint64_t count);
+void insert_or_update_word_n(HashTable *table, const char *word, size_t length, uint64_t count);
 void insert_word(HashTable *table, const char *word);
+const HashSlot *hash_table_find(const HashTable *table, const char *word, size_t length);
+int hash_table_next(const HashTable *table, size_t *position, WordCount *entry);
+size_t hash_table_memory(const HashTable *table);
+void hash_table_probe_stats(const HashTable *table, double *mean_probe, size_t *max_probe);
+void hash_table_clear(HashTable *table);
 void free_hash_table(HashTable *table);
 
 /* Comparison Function for qsort */
 int compare_counts(const void *a, const void *b);
 
+#endif
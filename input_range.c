@@ -0,0 +1,84 @@
+/* input_range.c */
+
+#include "input_range.h"
+#include "decompress.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Tokenize the range straight from a mapping of the file.
+ * Returns -1 if the file cannot be mapped (e.g. a pipe). */
+static int tokenize_mapped(FILE *fp, off_t offset, off_t length, Tokenizer *tokenizer,
+                           token_callback emit, void *context, const int *stop) {
+    struct stat st;
+    if (fstat(fileno(fp), &st) == -1 || !S_ISREG(st.st_mode) || offset + length > st.st_size) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    /* mmap needs an offset that is a multiple of the page size */
+    long page_size = sysconf(_SC_PAGESIZE);
+    off_t map_offset = offset - offset % page_size;
+    size_t skip = (size_t)(offset - map_offset);
+    size_t map_length = skip + (size_t)length;
+
+    char *map = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fileno(fp), map_offset);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, map_length, MADV_SEQUENTIAL);
+    madvise(map, map_length, MADV_WILLNEED);
+
+    const char *data = map + skip;
+    size_t remaining = (size_t)length;
+    while (remaining > 0 && !*stop) {
+        size_t window = remaining < INPUT_WINDOW_SIZE ? remaining : INPUT_WINDOW_SIZE;
+        tokenizer_feed(tokenizer, data, window, emit, context);
+        data += window;
+        remaining -= window;
+    }
+
+    munmap(map, map_length);
+    return 0;
+}
+
+/* Tokenize the range line by line, for files that cannot be mapped */
+static int tokenize_stream(FILE *fp, off_t offset, off_t remaining, Tokenizer *tokenizer,
+                           token_callback emit, void *context, const int *stop) {
+    if (fseeko(fp, offset, SEEK_SET) == -1) {
+        perror("fseeko input_file");
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t read;
+    while (remaining > 0 && !*stop && (read = getline(&line, &capacity, fp)) != -1) {
+        /* The last line is cut at the end of the range (always right after a delimiter) */
+        if (read > remaining) {
+            read = remaining;
+        }
+        remaining -= read;
+        tokenizer_feed(tokenizer, line, (size_t)read, emit, context);
+    }
+    free(line);
+    return 0;
+}
+
+/* Tokenize [offset, offset + length) of fp; words left open at the end of
+ * the range stay in the tokenizer until tokenizer_finish. The range of a
+ * gzip or zstd file is decompressed on the way (decompress.h). */
+int tokenize_file_range(FILE *fp, off_t offset, off_t length, Tokenizer *tokenizer,
+                        token_callback emit, void *context, const int *stop) {
+    InputFormat format = input_format(fileno(fp));
+    if (format != INPUT_PLAIN) {
+        return tokenize_compressed(fileno(fp), format, offset, length, tokenizer, emit, context, stop);
+    }
+    if (tokenize_mapped(fp, offset, length, tokenizer, emit, context, stop) == 0) {
+        return 0;
+    }
+    return tokenize_stream(fp, offset, length, tokenizer, emit, context, stop);
+}
@@ -0,0 +1,26 @@
+/* input_range.h */
+
+#ifndef INPUT_RANGE_H
+#define INPUT_RANGE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "tokenizer.h"
+
+/*
+ * Feeds the byte range [offset, offset + length) of an input file to a
+ * tokenizer. Regular files are mapped read-only (MADV_SEQUENTIAL and
+ * MADV_WILLNEED), so words are reported as views into the page cache and
+ * concurrent readers share the same pages. Other files are read line by
+ * line, and gzip or zstd files are decompressed (decompress.h). Reading stops
+ * early once *stop becomes non-zero.
+ */
+
+/* Size of the slices of a mapping handed to the tokenizer at a time */
+#define INPUT_WINDOW_SIZE (8 * 1024 * 1024)
+
+/* Input Range Functions */
+int tokenize_file_range(FILE *fp, off_t offset, off_t length, Tokenizer *tokenizer,
+                        token_callback emit, void *context, const int *stop);
+
+#endif
@@ -0,0 +1,179 @@
+/* input_set.c */
+
+#include "input_set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+void input_set_init(InputSet *set) {
+    set->files = NULL;
+    set->count = 0;
+    set->capacity = 0;
+    set->total_size = 0;
+}
+
+static void report(const char *path) {
+    fprintf(stderr, "Error: Input '%s' cannot be read: %s\n", path, strerror(errno));
+}
+
+/* Check that the file can be opened and record its size */
+static int add_file(InputSet *set, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        report(path);
+        return -1;
+    }
+    struct stat st;
+    int status = fstat(fd, &st);
+    close(fd);
+    if (status == -1) {
+        report(path);
+        return -1;
+    }
+
+    if (set->count >= set->capacity) {
+        size_t new_capacity = set->capacity ? set->capacity * 2 : 16;
+        InputFile *temp = realloc(set->files, new_capacity * sizeof(InputFile));
+        if (!temp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        set->files = temp;
+        set->capacity = new_capacity;
+    }
+    char *copy = strdup(path);
+    if (!copy) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    set->files[set->count].path = copy;
+    set->files[set->count].size = st.st_size;
+    set->count++;
+    set->total_size += st.st_size;
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int add_directory(InputSet *set, const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        report(path);
+        return -1;
+    }
+
+    // Names are sorted so that the same directory always gives the same file order
+    char **names = NULL;
+    size_t num_names = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (num_names >= capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            char **temp = realloc(names, capacity * sizeof(char *));
+            if (!temp) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            names = temp;
+        }
+        names[num_names] = strdup(entry->d_name);
+        if (!names[num_names]) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        num_names++;
+    }
+    closedir(dir);
+    qsort(names, num_names, sizeof(char *), compare_names);
+
+    int status = 0;
+    size_t path_length = strlen(path);
+    for (size_t i = 0; i < num_names; i++) {
+        size_t size = path_length + strlen(names[i]) + 2;
+        char *child = malloc(size);
+        if (!child) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        snprintf(child, size, "%s%s%s", path, path_length && path[path_length - 1] == '/' ? "" : "/", names[i]);
+
+        struct stat st;
+        if (status == 0 && lstat(child, &st) == -1) {
+            report(child);
+            status = -1;
+        } else if (status == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                status = add_directory(set, child);
+            } else if (S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode) && stat(child, &st) == 0 && S_ISREG(st.st_mode))) {
+                status = add_file(set, child);
+            }
+        }
+        free(child);
+        free(names[i]);
+    }
+    free(names);
+    return status;
+}
+
+static int add_path(InputSet *set, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        report(path);
+        return -1;
+    }
+    return S_ISDIR(st.st_mode) ? add_directory(set, path) : add_file(set, path);
+}
+
+static int add_list(InputSet *set, const char *list_path) {
+    FILE *fp = fopen(list_path, "r");
+    if (!fp) {
+        report(list_path);
+        return -1;
+    }
+    int status = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while (status == 0 && (length = getline(&line, &capacity, fp)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length > 0) {
+            status = add_path(set, line);
+        }
+    }
+    if (status == 0 && ferror(fp)) {
+        report(list_path);
+        status = -1;
+    }
+    free(line);
+    fclose(fp);
+    return status;
+}
+
+/* Add the files named by one -i argument. Returns 0, or -1 after reporting
+ * the path that could not be read. */
+int input_set_add(InputSet *set, const char *arg) {
+    if (arg[0] == INPUT_LIST_PREFIX) {
+        return add_list(set, arg + 1);
+    }
+    return add_path(set, arg);
+}
+
+void input_set_free(InputSet *set) {
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->files[i].path);
+    }
+    free(set->files);
+    input_set_init(set);
+}
@@ -0,0 +1,39 @@
+/* input_set.h */
+
+#ifndef INPUT_SET_H
+#define INPUT_SET_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * The files behind lexan -i. Every argument is one of
+ *   a file         counted as is
+ *   a directory    every regular file below it, recursively, in name order
+ *                  (symbolic links to files are followed, to directories not)
+ *   @list          a text file with one path per line, each of which may
+ *                  again be a file or a directory; empty lines are skipped
+ * Files are opened once while they are added, so an unreadable input is
+ * reported before any process is started.
+ */
+
+#define INPUT_LIST_PREFIX '@'
+
+typedef struct InputFile {
+    char *path;
+    off_t size;
+} InputFile;
+
+typedef struct InputSet {
+    InputFile *files;
+    size_t count;
+    size_t capacity;
+    off_t total_size;
+} InputSet;
+
+/* Input Set Functions */
+void input_set_init(InputSet *set);
+int input_set_add(InputSet *set, const char *arg);
+void input_set_free(InputSet *set);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -7,32 +8,1168 @@
 #include <errno.h>
 #include <sys/times.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <limits.h>
 #include "lexan.h"      
+#include "splitter.h"
+#include "wire.h"
+#include "topk.h"
+#include "exclusion_set.h"
+#include "tokenizer.h"
+#include "threaded.h"
+#include "ring.h"
+#include "stats.h"
+#include "stream.h"
+#include "spill.h"
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+// How often the root checks for exited splitters with the ring transport (ms)
+#define RING_REAP_INTERVAL_MS 100
 
 
 
 volatile sig_atomic_t usr1_count = 0;
 volatile sig_atomic_t usr2_count = 0;
+volatile sig_atomic_t stop_requested = 0;
 int num_splitters = 0;
 int num_builders = 0;
 
-// Signal handlers
-void handle_usr1(int sig) {
-    (void)sig;
-    usr1_count++;
+// Signal handlers
+void handle_usr1(int sig) {
+    (void)sig;
+    usr1_count++;
+}
+
+void handle_usr2(int sig) {
+    (void)sig;
+    usr2_count++;
+}
+
+// SIGINT/SIGTERM end a --stream run after a final snapshot
+void handle_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// Split the input file into num_parts byte ranges. Every boundary is moved forward
+// so that it falls right after a word delimiter, which means a word never straddles
+// two ranges and each word is tokenized by exactly one splitter.
+int compute_input_splits(const char *path, int num_parts, off_t *offsets, off_t *lengths) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open input_file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat input_file");
+        close(fd);
+        return -1;
+    }
+    off_t file_size = st.st_size;
+
+    off_t start = 0;
+    for (int i = 0; i < num_parts; i++) {
+        off_t end = file_size;
+        if (i < num_parts - 1) {
+            end = (off_t)((double)file_size * (i + 1) / num_parts);
+            if (end < start) {
+                end = start;
+            }
+            // Scan from the byte before the target until a delimiter is found
+            off_t pos = end > 0 ? end - 1 : 0;
+            char buf[4096];
+            int found = 0;
+            while (!found && pos < file_size) {
+                ssize_t n = pread(fd, buf, sizeof(buf), pos);
+                if (n == -1) {
+                    if (errno == EINTR) continue;
+                    perror("pread input_file");
+                    close(fd);
+                    return -1;
+                }
+                if (n == 0) break;
+                for (ssize_t j = 0; j < n; j++) {
+                    if (buf[j] != '\0' && strchr(WORD_DELIMITERS, buf[j])) {
+                        end = pos + j + 1;
+                        found = 1;
+                        break;
+                    }
+                }
+                pos += n;
+            }
+            if (!found) {
+                end = file_size;
+            }
+        }
+        offsets[i] = start;
+        lengths[i] = end - start;
+        start = end;
+    }
+
+    close(fd);
+    return 0;
+}
+
+// Decide how large the input's chunks are. Splitters pull chunks from a shared
+// queue, so there are several per splitter: whoever finishes early takes more work
+// instead of waiting for the slowest one. A chunk_size of 0 picks about
+// CHUNKS_PER_SPLITTER chunks per splitter, none smaller than MIN_CHUNK_SIZE, unless
+// the whole input is too small to give every splitter a chunk of that size.
+off_t input_chunk_size(off_t total_size, off_t chunk_size) {
+    if (chunk_size > 0) {
+        return chunk_size;
+    }
+    off_t size = total_size / ((off_t)num_splitters * CHUNKS_PER_SPLITTER);
+    if (size < MIN_CHUNK_SIZE) {
+        size = MIN_CHUNK_SIZE;
+    }
+    off_t share = (total_size + num_splitters - 1) / num_splitters;
+    if (size > share) {
+        size = share;
+    }
+    return size > 0 ? size : 1;
+}
+
+// Largest chunks first, so the long pieces of work start early and the small
+// files fill the gaps at the end; equal chunks keep file order
+static int compare_chunks(const void *a, const void *b) {
+    const Chunk *x = a, *y = b;
+    if (x->length != y->length) {
+        return x->length > y->length ? -1 : 1;
+    }
+    if (x->file != y->file) {
+        return x->file < y->file ? -1 : 1;
+    }
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+// Cut every input file into delimiter-aligned chunks, a small file being a single
+// chunk; gzip and zstd files are cut between members or frames (decompress.h).
+// Returns the chunks largest first in *chunks (freed by the caller) and their
+// number, or -1 if a file could not be read.
+ssize_t plan_input_chunks(const InputSet *inputs, off_t chunk_size, Chunk **chunks) {
+    off_t target = input_chunk_size(inputs->total_size, chunk_size);
+    size_t num_chunks = 0;
+    for (size_t i = 0; i < inputs->count; i++) {
+        off_t parts = (inputs->files[i].size + target - 1) / target;
+        num_chunks += parts > 1 ? (size_t)parts : 1;
+    }
+    *chunks = malloc((num_chunks ? num_chunks : 1) * sizeof(Chunk));
+    if (!*chunks) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < inputs->count; i++) {
+        const InputFile *input = &inputs->files[i];
+        int fd = open(input->path, O_RDONLY);
+        if (fd == -1) {
+            perror("open input_file");
+            free(*chunks);
+            *chunks = NULL;
+            return -1;
+        }
+        // Compressed files can only be cut between their members or frames
+        InputFormat format = input_format(fd);
+        if (!input_format_supported(format)) {
+            fprintf(stderr, "Error: '%s' is zstd-compressed, but lexan was built without HAVE_ZSTD.\n", input->path);
+            close(fd);
+            free(*chunks);
+            *chunks = NULL;
+            return -1;
+        }
+        off_t *offsets, *lengths;
+        size_t parts;
+        int status;
+        if (format != INPUT_PLAIN) {
+            status = compressed_splits(fd, format, input->size, target, &offsets, &lengths, &parts);
+        } else {
+            off_t count = (input->size + target - 1) / target;
+            parts = count < 1 ? 1 : count > INT_MAX ? INT_MAX : (size_t)count;
+            offsets = malloc(parts * sizeof(off_t));
+            lengths = malloc(parts * sizeof(off_t));
+            if (!offsets || !lengths) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+            status = compute_input_splits(input->path, (int)parts, offsets, lengths);
+        }
+        close(fd);
+        if (status == -1) {
+            fprintf(stderr, "Error: Could not split input file '%s'.\n", input->path);
+            free(offsets);
+            free(lengths);
+            free(*chunks);
+            *chunks = NULL;
+            return -1;
+        }
+        for (size_t j = 0; j < parts; j++) {
+            (*chunks)[used].file = i;
+            (*chunks)[used].offset = (uint64_t)offsets[j];
+            (*chunks)[used].length = (uint64_t)lengths[j];
+            used++;
+        }
+        free(offsets);
+        free(lengths);
+    }
+    qsort(*chunks, used, sizeof(Chunk), compare_chunks);
+    return (ssize_t)used;
+}
+
+// Append a (word, count) pair to a growable array of WordCount entries, copying the word
+// into the arena. Used when builders own disjoint sets of words and no merging is needed.
+void append_word_count(WordCount **array, size_t *size, size_t *capacity, Arena *words,
+                       const char *word, size_t length, uint64_t count) {
+    if (*size >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : INITIAL_HASH_SIZE;
+        WordCount *temp = realloc(*array, new_capacity * sizeof(WordCount));
+        if (!temp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        *array = temp;
+        *capacity = new_capacity;
+    }
+
+    (*array)[*size].word = arena_strndup(words, word, length);
+    (*array)[*size].count = count;
+    (*size)++;
+}
+
+
+// Record one (word, count) result reported by a builder
+void add_builder_count(BuilderResults *results, const char *word, size_t length, uint64_t count) {
+    if (results->routing == ROUTE_HASH) {
+        append_word_count(&results->word_array, &results->total_words, &results->word_array_capacity,
+                          &results->word_array_keys, word, length, count);
+    } else {
+        insert_or_update_word_n(results->hash_table, word, length, count);
+    }
+}
+
+// Count the words with splitter and builder threads inside this process (--threads).
+// The builders' tables are merged directly, without going through pipes: with hash
+// routing only each builder's local top_k is kept, just like the builder processes send.
+int run_thread_pipeline(const char *exclusion_file, ChunkQueue *chunks,
+                        StatsRegion *stats, int top_k, BuilderResults *results) {
+    ExclusionSet exclusion_set;
+    if (exclusion_set_load(&exclusion_set, exclusion_file) == -1) {
+        fprintf(stderr, "Error: Could not read exclusion file '%s'.\n", exclusion_file);
+        return -1;
+    }
+
+    HashTable **tables = malloc(num_builders * sizeof(HashTable *));
+    ApproxCounter **counters = malloc(num_builders * sizeof(ApproxCounter *));
+    if (!tables || !counters) {
+        perror("malloc");
+        return -1;
+    }
+
+    ThreadedJob job = {
+        .exclusion_set = &exclusion_set,
+        .chunks = chunks,
+        .stats = stats,
+        .num_splitters = num_splitters,
+        .num_builders = num_builders,
+        .routing = results->routing,
+        .approx_capacity = (size_t)results->approx_capacity,
+    };
+    int status = run_threaded(&job, tables, counters, results->builder_elapsed_times);
+    exclusion_set_free(&exclusion_set);
+
+    // With hash routing only each builder's local top_k is kept, unless every word is wanted
+    int keep_local_top = results->routing == ROUTE_HASH && !results->all_words;
+    for (int i = 0; i < num_builders; i++) {
+        if (results->approx_capacity > 0) {
+            results->total_non_excluded_words += counters[i]->total_count;
+            if (approx_merge_counter(&results->approx, i, counters[i]) == -1) {
+                fprintf(stderr, "Builder %d produced a mismatched sketch.\n", i);
+                status = -1;
+            }
+            approx_counter_free(counters[i]);
+            free(counters[i]);
+        }
+        TopK local_top;
+        topk_init(&local_top, keep_local_top ? (size_t)top_k : 0);
+        size_t position = 0;
+        WordCount entry;
+        while (hash_table_next(tables[i], &position, &entry)) {
+            results->total_non_excluded_words += entry.count;
+            if (keep_local_top) {
+                topk_offer(&local_top, entry.word, entry.count);
+            } else {
+                add_builder_count(results, entry.word, strlen(entry.word), entry.count);
+            }
+        }
+        for (size_t j = 0; j < local_top.size; j++) {
+            const WordCount *selected = &local_top.heap[j];
+            add_builder_count(results, selected->word, strlen(selected->word), selected->count);
+        }
+        topk_free(&local_top);
+        free_hash_table(tables[i]);
+    }
+    free(tables);
+    free(counters);
+    return status;
+}
+
+// A splitter that exits with an error (e.g. a corrupt compressed input) has not
+// sent all of its words, so the run fails instead of reporting short counts
+void record_splitter_exit(ChildReaper *reaper, int i, int child_status) {
+    reaper->splitter_reaped[i] = 1;
+    if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+        reaper->failed++;
+    }
+}
+
+// Likewise for a builder, whose counts are lost even if part of its stream arrived
+void record_builder_exit(ChildReaper *reaper, int i, int child_status) {
+    reaper->builder_reaped[i] = 1;
+    if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+        reaper->builder_failed[i] = 1;
+    }
+    abandon_builder_rings(reaper, i);
+}
+
+// A builder that has exited or closed its result stream reads no more input, so
+// the splitters writing into its rings must fail the way they would on a pipe
+// without a reader rather than wait for space that never comes
+void abandon_builder_rings(ChildReaper *reaper, int i) {
+    for (int j = 0; reaper->rings && j < num_splitters; j++) {
+        Ring ring;
+        ring_attach(&ring, reaper->rings, j, i, -1, reaper->splitter_events[j]);
+        ring_abandon(&ring);
+    }
+}
+
+// Reap the children that have exited without blocking. A ring has no kernel end
+// that closes when its splitter dies, so with the ring transport the root closes
+// an exited splitter's rings itself; a crashed splitter then looks like end of
+// input to the builders.
+void reap_children(ChildReaper *reaper) {
+    for (int i = 0; i < num_splitters; i++) {
+        int child_status = 0;
+        if (reaper->splitter_reaped[i]) {
+            continue;
+        }
+        pid_t pid = waitpid(reaper->splitter_pids[i], &child_status, WNOHANG);
+        if (pid == 0 || (pid == -1 && errno == EINTR)) {
+            continue;
+        }
+        record_splitter_exit(reaper, i, pid == -1 ? 0 : child_status);
+        for (int j = 0; reaper->rings && j < num_builders; j++) {
+            Ring ring;
+            ring_attach(&ring, reaper->rings, i, j, -1, reaper->builder_events[j]);
+            ring_close(&ring);
+        }
+    }
+    for (int i = 0; i < num_builders; i++) {
+        if (reaper->builder_reaped[i]) {
+            continue;
+        }
+        int child_status = 0;
+        pid_t pid = waitpid(reaper->builder_pids[i], &child_status, WNOHANG);
+        if (pid == 0 || (pid == -1 && errno == EINTR)) {
+            continue;
+        }
+        record_builder_exit(reaper, i, pid == -1 ? 0 : child_status);
+    }
+}
+
+// Wait for the next word record of a builder's stream; its trailer is recorded
+// on the way. Returns 1 with *record set, 0 at the end of the stream, -1 if the
+// stream is malformed or unreadable. The record is valid until the next call.
+static int next_sorted_record(WireReader *reader, int builder, BuilderResults *results, ChildReaper *reaper,
+                              int poll_timeout, WireRecord *record) {
+    for (;;) {
+        int status = wire_next_record(reader, record);
+        if (status == 1 && record->is_trailer) {
+            reaper->builder_trailers[builder] = 1;
+            results->builder_elapsed_times[builder] = record->trailer.elapsed_time;
+            results->total_non_excluded_words += record->trailer.total_count;
+            continue;
+        }
+        if (status == 1 && record->is_sketch_row) {
+            status = -1;
+        }
+        if (status != 0) {
+            if (status == -1) {
+                fprintf(stderr, "Builder %d sent a malformed record.\n", builder);
+                reaper->builder_failed[builder] = 1;
+                abandon_builder_rings(reaper, builder);
+            }
+            return status;
+        }
+
+        struct pollfd poll_fd = { .fd = reader->fd, .events = POLLIN };
+        int ready = poll(&poll_fd, 1, poll_timeout);
+        reap_children(reaper);
+        if (ready == -1 && errno != EINTR) {
+            perror("poll");
+            reaper->builder_failed[builder] = 1;
+            abandon_builder_rings(reaper, builder);
+            return -1;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        ssize_t n = wire_reader_fill(reader);
+        if (n == -1 && errno == EAGAIN) {
+            continue;
+        }
+        if (n == -1) {
+            perror("read from builder");
+            reaper->builder_failed[builder] = 1;
+            abandon_builder_rings(reaper, builder);
+            return -1;
+        }
+        if (n == 0) {
+            if (wire_reader_pending(reader) > 0) {
+                fprintf(stderr, "Builder %d sent a truncated record.\n", builder);
+                reaper->builder_failed[builder] = 1;
+            }
+            abandon_builder_rings(reaper, builder);
+            return 0;
+        }
+    }
+}
+
+// With --mem-limit and round-robin routing every builder sends all of its words
+// in word order, so the root merges the streams like sorted runs, adding up the
+// counts of equal words, instead of rehashing every word into its table. Blocking
+// on one builder at a time is safe: builders only write once their input is done.
+// Returns 0, or -1 if a stream broke off.
+int merge_sorted_builder_results(WireReader *readers, BuilderResults *results, ChildReaper *reaper,
+                                 int poll_timeout) {
+    WireRecord *heads = malloc(num_builders * sizeof(WireRecord));
+    int *live = malloc(num_builders * sizeof(int));
+    if (!heads || !live) {
+        perror("malloc");
+        return -1;
+    }
+    int status = 0;
+    for (int i = 0; i < num_builders; i++) {
+        live[i] = next_sorted_record(&readers[i], i, results, reaper, poll_timeout, &heads[i]);
+        if (live[i] == -1) {
+            live[i] = 0;
+            status = -1;
+        }
+    }
+
+    for (;;) {
+        int smallest = -1;
+        for (int i = 0; i < num_builders; i++) {
+            if (live[i] && (smallest == -1 || strcmp(heads[i].word, heads[smallest].word) < 0)) {
+                smallest = i;
+            }
+        }
+        if (smallest == -1) {
+            break;
+        }
+        // Sum the word over every builder that holds it, then copy it before any stream moves on
+        uint64_t count = 0;
+        for (int i = 0; i < num_builders; i++) {
+            if (live[i] && heads[i].length == heads[smallest].length &&
+                memcmp(heads[i].word, heads[smallest].word, heads[i].length) == 0) {
+                count += heads[i].count;
+            }
+        }
+        append_word_count(&results->word_array, &results->total_words, &results->word_array_capacity,
+                          &results->word_array_keys, heads[smallest].word, heads[smallest].length, count);
+        const char *merged = results->word_array[results->total_words - 1].word;
+        uint32_t merged_length = heads[smallest].length;
+        for (int i = 0; i < num_builders; i++) {
+            if (live[i] && heads[i].length == merged_length && memcmp(heads[i].word, merged, merged_length) == 0) {
+                live[i] = next_sorted_record(&readers[i], i, results, reaper, poll_timeout, &heads[i]);
+                if (live[i] == -1) {
+                    live[i] = 0;
+                    status = -1;
+                }
+            }
+        }
+    }
+    free(heads);
+    free(live);
+    return status;
+}
+
+// Count the words with the fork/exec pipeline: splitter and builder processes
+// connected by pipes, with the root merging the builders' results as they arrive.
+int run_process_pipeline(const char *exclusion_file, ChunkQueue *chunks,
+                         StatsRegion *stats, int top_k, Transport transport, int combine_limit,
+                         BuilderResults *results) {
+    // Compile the exclusion list once into an in-memory file. Splitters map it
+    // read-only through /dev/fd, so they share its pages instead of each one
+    // parsing the list and building its own copy. Lists that are already
+    // compiled (see exclcompile) are mapped directly.
+    const char *splitter_exclusion_file = exclusion_file;
+    char compiled_exclusion_path[32];
+    int exclusion_fd = -1;
+    if (!exclusion_set_is_compiled(exclusion_file)) {
+        ExclusionSet exclusion_set;
+        if (exclusion_set_build(&exclusion_set, exclusion_file) == -1) {
+            fprintf(stderr, "Error: Could not read exclusion file '%s'.\n", exclusion_file);
+            return -1;
+        }
+        exclusion_fd = memfd_create("lexan-exclusions", 0);
+        if (exclusion_fd == -1 || exclusion_set_write_fd(&exclusion_set, exclusion_fd) == -1) {
+            perror("memfd exclusion set");
+            return -1;
+        }
+        exclusion_set_free(&exclusion_set);
+        snprintf(compiled_exclusion_path, sizeof(compiled_exclusion_path), "/dev/fd/%d", exclusion_fd);
+        splitter_exclusion_file = compiled_exclusion_path;
+    }
+
+    // Every child fills its slot of the stats region before exiting
+    char stats_spec[STATS_SPEC_SIZE];
+    stats_region_spec(stats, stats_spec, sizeof(stats_spec));
+
+    // Set up signal handlers
+    signal(SIGUSR1, handle_usr1);
+    signal(SIGUSR2, handle_usr2);
+    // Allocate memory for PIDs and pipes
+    // splitter_to_builder_pipes[s] holds one pipe per builder for splitter s:
+    // [s][2 * b] is the read end (builder b) and [s][2 * b + 1] the write end (splitter s).
+    // Every splitter->builder edge has its own pipe, so splitters can write large
+    // buffers without their frames interleaving in a shared pipe.
+    pid_t *builder_pids = malloc(num_builders * sizeof(pid_t));
+    pid_t *splitter_pids = malloc(num_splitters * sizeof(pid_t));
+    int **splitter_to_builder_pipes = malloc(num_splitters * sizeof(int *));
+    int **builder_to_root_pipes = malloc(num_builders * sizeof(int *));
+
+    if (!builder_pids || !splitter_pids || !splitter_to_builder_pipes || !builder_to_root_pipes) {
+        perror("malloc");
+        return -1;
+    }
+
+    // Allocate memory for start and end times of builders
+    struct timeval *builder_start_times = malloc(num_builders * sizeof(struct timeval));
+    struct timeval *builder_end_times = malloc(num_builders * sizeof(struct timeval));
+
+    if (!builder_start_times || !builder_end_times) {
+        perror("malloc");
+        return -1;
+    }
+
+    // The pipe matrix needs 2 * num_splitters * num_builders descriptors
+    struct rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0 && fd_limit.rlim_cur < fd_limit.rlim_max) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fd_limit);
+    }
+
+    // With the ring transport the words go through one shared-memory ring per edge
+    // (see ring.h). Every splitter and builder gets an eventfd to sleep on, and the
+    // edge's "pipe" below holds duplicates of the eventfds its two ends use to wake
+    // each other, so the descriptor bookkeeping is the same for both transports.
+    RingRegion ring_region;
+    char ring_spec[RING_SPEC_SIZE] = "";
+    int *splitter_events = NULL;
+    int *builder_events = NULL;
+    if (transport == TRANSPORT_RING) {
+        if (ring_region_create(&ring_region, num_splitters, num_builders, RING_CAPACITY) == -1) {
+            perror("create splitter rings");
+            return -1;
+        }
+        ring_region_spec(&ring_region, ring_spec, sizeof(ring_spec));
+        splitter_events = malloc(num_splitters * sizeof(int));
+        builder_events = malloc(num_builders * sizeof(int));
+        if (!splitter_events || !builder_events) {
+            perror("malloc");
+            return -1;
+        }
+        for (int i = 0; i < num_splitters; i++) {
+            if ((splitter_events[i] = eventfd(0, 0)) == -1) {
+                perror("eventfd");
+                return -1;
+            }
+        }
+        for (int i = 0; i < num_builders; i++) {
+            if ((builder_events[i] = eventfd(0, 0)) == -1) {
+                perror("eventfd");
+                return -1;
+            }
+        }
+    }
+
+    // Create pipes for each splitter->builder edge
+    for (int i = 0; i < num_splitters; i++) {
+        splitter_to_builder_pipes[i] = malloc(2 * num_builders * sizeof(int));
+        if (!splitter_to_builder_pipes[i]) {
+            perror("malloc");
+            return -1;
+        }
+        for (int j = 0; j < num_builders; j++) {
+            if (transport == TRANSPORT_RING) {
+                splitter_to_builder_pipes[i][2 * j] = dup(splitter_events[i]);
+                splitter_to_builder_pipes[i][2 * j + 1] = dup(builder_events[j]);
+                if (splitter_to_builder_pipes[i][2 * j] == -1 || splitter_to_builder_pipes[i][2 * j + 1] == -1) {
+                    perror("dup eventfd");
+                    return -1;
+                }
+            } else if (pipe(&splitter_to_builder_pipes[i][2 * j]) == -1) {
+                perror("pipe");
+                return -1;
+            }
+        }
+    }
+
+    // Create pipes for each builder
+    for (int i = 0; i < num_builders; i++) {
+        builder_to_root_pipes[i] = malloc(2 * sizeof(int));
+        if (!builder_to_root_pipes[i]) {
+            perror("malloc");
+            return -1;
+        }
+
+        if (pipe(builder_to_root_pipes[i]) == -1) {
+            perror("pipe");
+            return -1;
+        }
+    }
+
+    // Create builders
+    for (int i = 0; i < num_builders; i++) {
+        builder_pids[i] = fork();
+        if (builder_pids[i] < 0) {
+            perror("fork builder");
+            return -1;
+        }
+        if (builder_pids[i] == 0) {
+            // Child process (builder)
+            // Redirect builder_to_root_pipes[i][1] to STDOUT
+            if (dup2(builder_to_root_pipes[i][1], STDOUT_FILENO) == -1) {
+                perror("dup2 STDOUT");
+                _exit(EXIT_FAILURE);
+            }
+
+            // Prepare input_fds_str with the read end of every splitter's pipe to this builder
+            char *input_fds_str = malloc(12 * num_splitters + 1);
+            if (!input_fds_str) {
+                perror("malloc");
+                _exit(EXIT_FAILURE);
+            }
+            input_fds_str[0] = '\0';
+            for (int j = 0; j < num_splitters; j++) {
+                char fd_str[12];
+                snprintf(fd_str, sizeof(fd_str), "%d ", splitter_to_builder_pipes[j][2 * i]);
+                strcat(input_fds_str, fd_str);
+            }
+
+            // Close all pipe file descriptors in the child except this builder's inputs
+            for (int j = 0; j < num_splitters; j++) {
+                for (int k = 0; k < num_builders; k++) {
+                    if (k != i) {
+                        close(splitter_to_builder_pipes[j][2 * k]);
+                    }
+                    close(splitter_to_builder_pipes[j][2 * k + 1]);
+                }
+            }
+            for (int j = 0; j < num_builders; j++) {
+                close(builder_to_root_pipes[j][0]);
+                close(builder_to_root_pipes[j][1]);
+            }
+            if (exclusion_fd != -1) {
+                close(exclusion_fd);
+            }
+
+            // With hash routing the builder owns its words and only sends its local top_k,
+            // unless the root needs every word for an index
+            char builder_top_k_str[12];
+            snprintf(builder_top_k_str, sizeof(builder_top_k_str), "%d",
+                     results->routing == ROUTE_HASH && !results->all_words ? top_k : 0);
+
+            char builder_id_str[12], approx_str[12], mem_limit_str[24];
+            snprintf(builder_id_str, sizeof(builder_id_str), "%d", i);
+            snprintf(approx_str, sizeof(approx_str), "%d", results->approx_capacity);
+            snprintf(mem_limit_str, sizeof(mem_limit_str), "%" PRIu64, results->mem_limit);
+            if (transport == TRANSPORT_RING) {
+                char wait_fd_str[12];
+                snprintf(wait_fd_str, sizeof(wait_fd_str), "%d", builder_events[i]);
+                execl("./builder", "builder", input_fds_str, builder_top_k_str, stats_spec, builder_id_str,
+                      approx_str, mem_limit_str, ring_spec, wait_fd_str, NULL);
+            } else {
+                execl("./builder", "builder", input_fds_str, builder_top_k_str, stats_spec, builder_id_str,
+                      approx_str, mem_limit_str, NULL);
+            }
+            perror("execl builder");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    // Parent process: Close the read ends of splitter_to_builder_pipes and the write ends of builder_to_root_pipes
+    for (int i = 0; i < num_splitters; i++) {
+        for (int j = 0; j < num_builders; j++) {
+            close(splitter_to_builder_pipes[i][2 * j]);
+        }
+    }
+    for (int i = 0; i < num_builders; i++) {
+        close(builder_to_root_pipes[i][1]);
+    }
+
+    // Create splitters
+    for (int i = 0; i < num_splitters; i++) {
+        splitter_pids[i] = fork();
+        if (splitter_pids[i] < 0) {
+            perror("fork splitter");
+            return -1;
+        }
+        if (splitter_pids[i] == 0) {
+            // Child process (splitter)
+            // Prepare pipe_fds_str
+            char pipe_fds_str[4096] = "";
+            for (int j = 0; j < num_builders; j++) {
+                char fd_str[12];
+                snprintf(fd_str, sizeof(fd_str), "%d ", splitter_to_builder_pipes[i][2 * j + 1]);
+                strcat(pipe_fds_str, fd_str);
+            }
+
+            // Convert splitter_id, num_builders and the chunk queue to strings
+            char splitter_id_str[12], num_builders_str[12];
+            char chunks_str[CHUNK_QUEUE_SPEC_SIZE];
+            snprintf(splitter_id_str, sizeof(splitter_id_str), "%d", i);
+            snprintf(num_builders_str, sizeof(num_builders_str), "%d", num_builders);
+            chunk_queue_spec(chunks, chunks_str, sizeof(chunks_str));
+
+            // Close unused file descriptors in the child: the write ends of the
+            // splitters forked after this one are still open in the parent
+            for (int j = i + 1; j < num_splitters; j++) {
+                for (int k = 0; k < num_builders; k++) {
+                    close(splitter_to_builder_pipes[j][2 * k + 1]);
+                }
+            }
+            for (int j = 0; j < num_builders; j++) {
+                close(builder_to_root_pipes[j][0]);
+            }
+
+            const char *routing_str = results->routing == ROUTE_HASH ? ROUTING_HASH_NAME : ROUTING_ROUND_ROBIN_NAME;
+            char combine_str[12];
+            snprintf(combine_str, sizeof(combine_str), "%d", combine_limit);
+            if (transport == TRANSPORT_RING) {
+                char wait_fd_str[12];
+                snprintf(wait_fd_str, sizeof(wait_fd_str), "%d", splitter_events[i]);
+                execl("./splitter", "splitter", splitter_id_str, splitter_exclusion_file, num_builders_str, pipe_fds_str,
+                      chunks_str, routing_str, combine_str, stats_spec, ring_spec, wait_fd_str, NULL);
+            } else {
+                execl("./splitter", "splitter", splitter_id_str, splitter_exclusion_file, num_builders_str, pipe_fds_str,
+                      chunks_str, routing_str, combine_str, stats_spec, NULL);
+            }
+            perror("execl splitter");
+            _exit(EXIT_FAILURE);
+        }
+
+        // Parent process: Close the write ends of this splitter's pipes, as they are handled by the splitter
+        for (int j = 0; j < num_builders; j++) {
+            close(splitter_to_builder_pipes[i][2 * j + 1]);
+        }
+    }
+
+    // Collect results from all builders concurrently. The pipes are multiplexed with
+    // poll() and records are merged as soon as they arrive, so a builder is never
+    // stalled on a full pipe while the root is busy waiting for another process.
+    struct pollfd *builder_poll_fds = malloc(num_builders * sizeof(struct pollfd));
+    WireReader *builder_readers = malloc(num_builders * sizeof(WireReader));
+    if (!builder_poll_fds || !builder_readers) {
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < num_builders; i++) {
+        int fd = builder_to_root_pipes[i][0];
+        int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+            perror("fcntl O_NONBLOCK");
+            return -1;
+        }
+        builder_poll_fds[i].fd = fd;
+        builder_poll_fds[i].events = POLLIN;
+        wire_reader_init(&builder_readers[i], fd, WIRE_BUFFER_SIZE);
+    }
+
+    // With the ring transport the root also reaps children while it waits (see
+    // reap_children), so it wakes up every RING_REAP_INTERVAL_MS
+    int *splitter_reaped = calloc(num_splitters, sizeof(int));
+    int *builder_reaped = calloc(num_builders, sizeof(int));
+    int *builder_trailers = calloc(num_builders, sizeof(int));
+    int *builder_failed = calloc(num_builders, sizeof(int));
+    if (!splitter_reaped || !builder_reaped || !builder_trailers || !builder_failed) {
+        perror("calloc");
+        return -1;
+    }
+    ChildReaper reaper = {
+        .splitter_pids = splitter_pids,
+        .splitter_reaped = splitter_reaped,
+        .builder_pids = builder_pids,
+        .builder_reaped = builder_reaped,
+        .rings = transport == TRANSPORT_RING ? &ring_region : NULL,
+        .splitter_events = splitter_events,
+        .builder_events = builder_events,
+        .builder_trailers = builder_trailers,
+        .builder_failed = builder_failed,
+    };
+    int poll_timeout = transport == TRANSPORT_RING ? RING_REAP_INTERVAL_MS : -1;
+
+    // Sorted builder streams are merged in word order instead of as they arrive
+    int open_builders = num_builders;
+    int merge_status = 0;
+    if (results->mem_limit > 0 && results->routing == ROUTE_ROUND_ROBIN) {
+        merge_status = merge_sorted_builder_results(builder_readers, results, &reaper, poll_timeout);
+        if (merge_status == -1) {
+            fprintf(stderr, "Could not merge the sorted builder streams.\n");
+        }
+        for (int i = 0; i < num_builders; i++) {
+            wire_reader_free(&builder_readers[i]);
+        }
+        open_builders = 0;
+    }
+    while (open_builders > 0) {
+        int ready = poll(builder_poll_fds, num_builders, poll_timeout);
+        reap_children(&reaper);
+        if (ready == -1) {
+            if (errno == EINTR) continue; // SIGUSR1/SIGUSR2 from the children
+            perror("poll");
+            return -1;
+        }
+
+        for (int i = 0; i < num_builders; i++) {
+            if (builder_poll_fds[i].fd < 0 || !(builder_poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            WireReader *reader = &builder_readers[i];
+
+            // Drain everything that is currently available on this pipe
+            int finished = 0;
+            for (;;) {
+                ssize_t n = wire_reader_fill(reader);
+                if (n == -1 && errno == EAGAIN) {
+                    break;
+                }
+                if (n == -1) {
+                    perror("read from builder");
+                    builder_failed[i] = 1;
+                    finished = 1;
+                    break;
+                }
+
+                WireRecord record;
+                int status;
+                while ((status = wire_next_record(reader, &record)) == 1) {
+                    if (record.is_trailer) {
+                        // The trailer carries the builder's timing information and the
+                        // total of all its counts, including words it did not send
+                        builder_trailers[i] = 1;
+                        results->builder_elapsed_times[i] = record.trailer.elapsed_time;
+                        results->total_non_excluded_words += record.trailer.total_count; // Update total word count
+                    } else if (record.is_sketch_row) {
+                        const WireSketchRow *row = &record.sketch_row;
+                        if (results->approx_capacity == 0 ||
+                            approx_merge_sketch_row(&results->approx, i, row->depth, row->width, row->row,
+                                                    row->floor, record.counters) == -1) {
+                            status = -1;
+                            break;
+                        }
+                    } else if (results->approx_capacity > 0) {
+                        approx_merge_candidate(&results->approx, i, record.word, record.length, record.count,
+                                               record.error);
+                    } else {
+                        add_builder_count(results, record.word, record.length, record.count);
+                    }
+                }
+                if (status == -1) {
+                    fprintf(stderr, "Builder %d sent a malformed record.\n", i);
+                    builder_failed[i] = 1;
+                    finished = 1;
+                    break;
+                }
+
+                if (n == 0) {
+                    if (wire_reader_pending(reader) > 0) {
+                        fprintf(stderr, "Builder %d sent a truncated record.\n", i);
+                        builder_failed[i] = 1;
+                    }
+                    finished = 1;
+                    break;
+                }
+            }
+
+            if (finished) {
+                abandon_builder_rings(&reaper, i);
+                wire_reader_free(reader);
+                builder_poll_fds[i].fd = -1;
+                open_builders--;
+            }
+        }
+    }
+    free(builder_poll_fds);
+    free(builder_readers);
+
+    // Close all read ends of builder_to_root_pipes
+    for (int i = 0; i < num_builders; i++) {
+        close(builder_to_root_pipes[i][0]);
+    }
+
+    // Wait for all splitters and builders to finish. With pipes a dead builder
+    // breaks its splitters' writes, so blocking in waitpid is safe. A splitter
+    // blocked on the ring of a builder that died only returns once the reaper
+    // abandons that ring, so with rings the root polls with growing sleeps.
+    if (exclusion_fd != -1) {
+        close(exclusion_fd);
+    }
+    for (int i = 0; transport == TRANSPORT_PIPE && i < num_splitters; i++) {
+        int child_status;
+        if (splitter_reaped[i]) {
+            continue;
+        }
+        while (waitpid(splitter_pids[i], &child_status, 0) == -1) {
+            if (errno != EINTR) {
+                child_status = 0;
+                break;
+            }
+        }
+        record_splitter_exit(&reaper, i, child_status);
+    }
+    for (int i = 0; transport == TRANSPORT_PIPE && i < num_builders; i++) {
+        int child_status;
+        if (builder_reaped[i]) {
+            continue;
+        }
+        while (waitpid(builder_pids[i], &child_status, 0) == -1) {
+            if (errno != EINTR) {
+                child_status = 0;
+                break;
+            }
+        }
+        record_builder_exit(&reaper, i, child_status);
+    }
+    int reap_sleep_ms = 1;
+    while (transport == TRANSPORT_RING) {
+        reap_children(&reaper);
+        int pending = 0;
+        for (int i = 0; i < num_splitters; i++) {
+            pending += !splitter_reaped[i];
+        }
+        for (int i = 0; i < num_builders; i++) {
+            pending += !builder_reaped[i];
+        }
+        if (pending == 0) {
+            break;
+        }
+        poll(NULL, 0, reap_sleep_ms);
+        if (reap_sleep_ms < RING_REAP_INTERVAL_MS) {
+            reap_sleep_ms *= 2;
+        }
+    }
+
+    // Free allocated resources and close any open file descriptors
+    for (int i = 0; i < num_splitters; i++) {
+        free(splitter_to_builder_pipes[i]);
+    }
+    for (int i = 0; i < num_builders; i++) {
+        free(builder_to_root_pipes[i]);
+    }
+
+    if (transport == TRANSPORT_RING) {
+        for (int i = 0; i < num_splitters; i++) {
+            close(splitter_events[i]);
+        }
+        for (int i = 0; i < num_builders; i++) {
+            close(builder_events[i]);
+        }
+        ring_region_unmap(&ring_region);
+    }
+
+    free(builder_pids);
+    free(splitter_pids);
+    free(splitter_reaped);
+    free(builder_reaped);
+    free(splitter_events);
+    free(builder_events);
+    free(splitter_to_builder_pipes);
+    free(builder_to_root_pipes);
+    free(builder_start_times);
+    free(builder_end_times);
+
+    // A builder whose stream broke off or ended without its trailer did not send
+    // all of its counts, whatever its exit status
+    int failed_builders = 0;
+    for (int i = 0; i < num_builders; i++) {
+        if (builder_failed[i] || !builder_trailers[i]) {
+            failed_builders++;
+        }
+    }
+    free(builder_trailers);
+    free(builder_failed);
+    if (reaper.failed > 0) {
+        fprintf(stderr, "Error: %d splitter(s) failed; the counts would be incomplete.\n", reaper.failed);
+        return -1;
+    }
+    if (failed_builders > 0) {
+        fprintf(stderr, "Error: %d builder(s) failed; the counts would be incomplete.\n", failed_builders);
+        return -1;
+    }
+    return merge_status;
 }
 
-void handle_usr2(int sig) {
-    (void)sig;
-    usr2_count++;
+
+// Write one snapshot of a --stream run. The output file is replaced atomically,
+// so readers always see a complete snapshot; the final one is also printed.
+void write_snapshot(const WordCount *top, size_t count, uint64_t total_words, uint64_t snapshot,
+                    int final, void *context) {
+    const char *output_file = context;
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", output_file);
+    FILE *out_fp = fopen(temp_path, "w");
+    if (!out_fp) {
+        perror("fopen snapshot");
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out_fp, "%s: %" PRIu64 "/%" PRIu64 "\n", top[i].word, top[i].count, total_words);
+        if (final) {
+            printf("%s: %" PRIu64 "/%" PRIu64 "\n", top[i].word, top[i].count, total_words);
+        }
+    }
+    if (fclose(out_fp) == EOF || rename(temp_path, output_file) == -1) {
+        perror("write snapshot");
+        return;
+    }
+    printf("Snapshot %" PRIu64 ": %" PRIu64 " words%s\n", snapshot, total_words, final ? " (final)" : "");
+    fflush(stdout);
+}
+
+// Count an unbounded stream from standard input (--stream), writing a top_k
+// snapshot to output_file every snapshot_interval seconds and/or every
+// snapshot_tokens words, and once more when the input ends or on SIGINT/SIGTERM
+int run_stream_pipeline(const char *exclusion_file, const char *output_file, int top_k, RoutingMode routing,
+                        double snapshot_interval, uint64_t snapshot_tokens) {
+    ExclusionSet exclusion_set;
+    if (exclusion_set_load(&exclusion_set, exclusion_file) == -1) {
+        fprintf(stderr, "Error: Could not read exclusion file '%s'.\n", exclusion_file);
+        return -1;
+    }
+
+    // Installed without SA_RESTART, so a stop interrupts the root's poll()
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = handle_stop;
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+
+    StreamJob job = {
+        .input_fd = STDIN_FILENO,
+        .exclusion_set = &exclusion_set,
+        .num_splitters = num_splitters,
+        .num_builders = num_builders,
+        .routing = routing,
+        .top_k = (size_t)top_k,
+        .snapshot_interval = snapshot_interval,
+        .snapshot_tokens = snapshot_tokens,
+        .stop = &stop_requested,
+        .on_snapshot = write_snapshot,
+        .context = (void *)output_file,
+    };
+    int status = run_stream(&job);
+    exclusion_set_free(&exclusion_set);
+    return status;
+}
+
+// Add the counts of an earlier run's index (--base=FILE) to this run's counts, so
+// only the new input has to go through the pipeline. Everything ends up in the
+// hash table; returns 0, or -1 if the index is malformed.
+int merge_base_index(const CountIndex *base, BuilderResults *results) {
+    if (results->routing == ROUTE_HASH || results->mem_limit > 0) {
+        for (size_t i = 0; i < results->total_words; i++) {
+            const WordCount *entry = &results->word_array[i];
+            insert_or_update_word_n(results->hash_table, entry->word, strlen(entry->word), entry->count);
+        }
+        free(results->word_array);
+        arena_free(&results->word_array_keys);
+        results->word_array = NULL;
+        results->total_words = 0;
+        results->word_array_capacity = 0;
+    }
+    size_t num_words = (size_t)base->header->num_words;
+    for (size_t i = 0; i < num_words; i++) {
+        if (base->offsets[i + 1] <= base->offsets[i]) {
+            return -1;
+        }
+        size_t length;
+        const char *word = count_index_word(base, i, &length);
+        if (word[length] != '\0' || memchr(word, '\0', length)) {
+            return -1;
+        }
+        insert_or_update_word_n(results->hash_table, word, length, base->counts[i]);
+    }
+    results->total_non_excluded_words += base->header->total_count;
+    return 0;
 }
 
+// Write the whole merged vocabulary as a binary count index (--index=FILE)
+// for lexquery. Returns 0, or -1 if the index could not be written.
+int write_count_index(const char *path, const BuilderResults *results, int merged_in_table) {
+    const WordCount *words = results->word_array;
+    size_t num_words = results->total_words;
+    WordCount *table_words = NULL;
+    if (merged_in_table) {
+        num_words = results->hash_table->count;
+        table_words = malloc((num_words ? num_words : 1) * sizeof(WordCount));
+        if (!table_words) {
+            perror("malloc");
+            return -1;
+        }
+        size_t position = 0, used = 0;
+        while (hash_table_next(results->hash_table, &position, &table_words[used])) {
+            used++;
+        }
+        words = table_words;
+    }
+    int status = count_index_write(path, words, num_words, results->total_non_excluded_words);
+    if (status == -1) {
+        perror("write count index");
+    }
+    free(table_words);
+    return status;
+}
 
+// Complete the root's statistics and write them together with every worker's
+// slot (--stats=FILE). Returns 0, or -1 if the file could not be written.
+int write_run_stats(const char *path, const StatsRegion *stats, RootStats *root, double run_start,
+                    uint64_t total_tokens, uint64_t distinct_words) {
+    root->total_tokens = total_tokens;
+    root->distinct_words = distinct_words;
+    root->total_time = stats_now() - run_start;
+    stats_usage(&root->usage, RUSAGE_SELF);
+    return stats_write_json(stats, root, path);
+}
 
 
 int main(int argc, char *argv[]) {
-    char *input_file = NULL, *exclusion_file = NULL, *output_file = NULL;
+    char *exclusion_file = NULL, *output_file = NULL;
+    InputSet inputs;
+    input_set_init(&inputs);
+    int have_input = 0;
     int top_k = 0;
+    RoutingMode routing = ROUTE_HASH;
+    int use_threads = 0;
+    Transport transport = TRANSPORT_PIPE;
+    int combine_limit = 0;
+    off_t chunk_size = 0;
+    const char *stats_file = NULL;
+    int approx_capacity = 0;
+    uint64_t mem_limit = 0;
+    const char *index_file = NULL;
+    const char *base_file = NULL;
+    int stream_mode = 0;
+    double snapshot_interval = STREAM_DEFAULT_INTERVAL;
+    uint64_t snapshot_tokens = 0;
 
     // Variables for timing
     struct tms tb1, tb2;
@@ -40,6 +1177,8 @@ int main(int argc, char *argv[]) {
     double ticspersec;
     double cpu_time, real_time;
 
+    double run_start = stats_now();
+
     // Initialize ticspersec for CPU time
     ticspersec = (double) sysconf(_SC_CLK_TCK);
 
@@ -52,12 +1191,102 @@ int main(int argc, char *argv[]) {
 
     // Parse command-line arguments
     for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0) {
+            // Run splitters and builders as threads of this process instead of forking
+            use_threads = 1;
+        } else if (strcmp(argv[i], "--transport") == 0) {
+            // How splitters hand words to builders: kernel pipes or shared-memory rings
+            ++i;
+            if (i < argc && strcmp(argv[i], TRANSPORT_PIPE_NAME) == 0) {
+                transport = TRANSPORT_PIPE;
+            } else if (i < argc && strcmp(argv[i], TRANSPORT_RING_NAME) == 0) {
+                transport = TRANSPORT_RING;
+            } else {
+                fprintf(stderr, "Invalid transport: %s\n", i < argc ? argv[i] : "(missing)");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--combine") == 0) {
+            // Let every splitter pre-aggregate up to this many distinct words before sending
+            ++i;
+            combine_limit = i < argc ? atoi(argv[i]) : 0;
+            if (combine_limit <= 0) {
+                fprintf(stderr, "Invalid combine limit: %s\n", i < argc ? argv[i] : "(missing)");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--stats=", 8) == 0 || strcmp(argv[i], "--stats") == 0) {
+            // Write per-worker counters and the root's phase timings as JSON
+            stats_file = argv[i][7] == '=' ? argv[i] + 8 : (i + 1 < argc ? argv[++i] : "");
+            if (stats_file[0] == '\0') {
+                fprintf(stderr, "Missing stats file name\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--approx") == 0) {
+            // Approximate counts in bounded memory: a sketch and this many heavy hitters per builder
+            ++i;
+            approx_capacity = i < argc ? atoi(argv[i]) : 0;
+            if (approx_capacity <= 0) {
+                fprintf(stderr, "Invalid number of heavy hitters: %s\n", i < argc ? argv[i] : "(missing)");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--index=", 8) == 0 || strcmp(argv[i], "--index") == 0) {
+            // Also write the whole vocabulary as a binary index for lexquery
+            index_file = argv[i][7] == '=' ? argv[i] + 8 : (i + 1 < argc ? argv[++i] : "");
+            if (index_file[0] == '\0') {
+                fprintf(stderr, "Missing index file name\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--base=", 7) == 0 || strcmp(argv[i], "--base") == 0) {
+            // Start from the counts of an earlier --index and only count the new input
+            base_file = argv[i][6] == '=' ? argv[i] + 7 : (i + 1 < argc ? argv[++i] : "");
+            if (base_file[0] == '\0') {
+                fprintf(stderr, "Missing base index file name\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--mem-limit") == 0) {
+            // Bytes a builder's table may take before it is spilled to a sorted run on disk
+            ++i;
+            long long limit = i < argc ? strtoll(argv[i], NULL, 10) : 0;
+            if (limit < SPILL_MIN_LIMIT) {
+                fprintf(stderr, "Invalid memory limit: %s (at least %d bytes)\n", i < argc ? argv[i] : "(missing)",
+                        SPILL_MIN_LIMIT);
+                return 1;
+            }
+            mem_limit = (uint64_t)limit;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            // Read an unbounded stream from stdin and write periodic snapshots
+            stream_mode = 1;
+        } else if (strcmp(argv[i], "--snapshot-interval") == 0) {
+            // Seconds between --stream snapshots (0: no timed snapshots)
+            ++i;
+            char *end = NULL;
+            snapshot_interval = i < argc ? strtod(argv[i], &end) : -1;
+            if (i >= argc || end == argv[i] || *end != '\0' || snapshot_interval < 0) {
+                fprintf(stderr, "Invalid snapshot interval: %s\n", i < argc ? argv[i] : "(missing)");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--snapshot-tokens") == 0) {
+            // Words between --stream snapshots (0: no snapshots by word count)
+            ++i;
+            long long tokens = i < argc ? strtoll(argv[i], NULL, 10) : -1;
+            if (tokens < 0) {
+                fprintf(stderr, "Invalid snapshot token count: %s\n", i < argc ? argv[i] : "(missing)");
+                return 1;
+            }
+            snapshot_tokens = (uint64_t)tokens;
+        } else if (strcmp(argv[i], "--chunk-size") == 0) {
+            // Cut the input into chunks of about this many bytes for the splitters to pull
+            ++i;
+            chunk_size = i < argc ? (off_t)strtoll(argv[i], NULL, 10) : 0;
+            if (chunk_size <= 0) {
+                fprintf(stderr, "Invalid chunk size: %s\n", i < argc ? argv[i] : "(missing)");
+                return 1;
+            }
         // Check if the argument starts with '-'
-        if (argv[i][0] == '-') {
+        } else if (argv[i][0] == '-') {
             // Ensure the flag has at least two characters (e.g., '-i')
             if (strlen(argv[i]) < 2) {
                 fprintf(stderr, "Invalid flag: %s\n", argv[i]);
-                fprintf(stderr, "Usage: %s -i input_file -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file\n", argv[0]);
+                fprintf(stderr, "Usage: %s -i input_file|directory|@file_list... -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file [-r hash|roundrobin] [--threads] [--transport pipe|ring] [--combine max_words] [--chunk-size bytes] [--stats=file] [--approx heavy_hitters] [--mem-limit bytes] [--index=file] [--base=file] [--stream [--snapshot-interval seconds] [--snapshot-tokens words]]\n", argv[0]);
                 return 1;
             }
 
@@ -67,7 +1296,13 @@ int main(int argc, char *argv[]) {
             // Assign values based on the flag
             switch (flag) {
                 case 'i':
-                    input_file = argv[++i];
+                    // Files, directories or @lists, up to the next flag; -i may be repeated
+                    have_input = 1;
+                    while (i + 1 < argc && argv[i + 1][0] != '-') {
+                        if (input_set_add(&inputs, argv[++i]) == -1) {
+                            return 1;
+                        }
+                    }
                     break;
                 case 'l':
                     num_splitters = atoi(argv[++i]);
@@ -96,23 +1331,34 @@ int main(int argc, char *argv[]) {
                 case 'o':
                     output_file = argv[++i];
                     break;
+                case 'r':
+                    ++i;
+                    if (i < argc && strcmp(argv[i], ROUTING_HASH_NAME) == 0) {
+                        routing = ROUTE_HASH;
+                    } else if (i < argc && strcmp(argv[i], ROUTING_ROUND_ROBIN_NAME) == 0) {
+                        routing = ROUTE_ROUND_ROBIN;
+                    } else {
+                        fprintf(stderr, "Invalid routing mode: %s\n", i < argc ? argv[i] : "(missing)");
+                        return 1;
+                    }
+                    break;
                 default:
                     fprintf(stderr, "Unknown flag: -%c\n", flag);
-                    fprintf(stderr, "Usage: %s -i input_file -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file\n", argv[0]);
+                    fprintf(stderr, "Usage: %s -i input_file|directory|@file_list... -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file [-r hash|roundrobin] [--threads] [--transport pipe|ring] [--combine max_words] [--chunk-size bytes] [--stats=file] [--approx heavy_hitters] [--mem-limit bytes] [--index=file] [--base=file] [--stream [--snapshot-interval seconds] [--snapshot-tokens words]]\n", argv[0]);
                     return 1;
             }
         } else {
             // Handle non-flag arguments, if necessary
             fprintf(stderr, "Unexpected argument: %s\n", argv[i]);
-            fprintf(stderr, "Usage: %s -i input_file -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file\n", argv[0]);
+            fprintf(stderr, "Usage: %s -i input_file|directory|@file_list... -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file [-r hash|roundrobin] [--threads] [--transport pipe|ring] [--combine max_words] [--chunk-size bytes] [--stats=file] [--approx heavy_hitters] [--mem-limit bytes] [--index=file] [--base=file] [--stream [--snapshot-interval seconds] [--snapshot-tokens words]]\n", argv[0]);
             return 1;
         }
     }
 
     // Check for missing or invalid arguments
-    if (!input_file || !exclusion_file || !output_file || num_splitters <= 0 || num_builders <= 0 || top_k <= 0) {
+    if ((!have_input && !stream_mode) || !exclusion_file || !output_file || num_splitters <= 0 || num_builders <= 0 || top_k <= 0) {
         fprintf(stderr, "Error: Missing or invalid arguments.\n");
-        fprintf(stderr, "Usage: %s -i input_file -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file\n", argv[0]);
+        fprintf(stderr, "Usage: %s -i input_file|directory|@file_list... -l num_splitters -m num_builders -t top_k -e exclusion_file -o output_file [-r hash|roundrobin] [--threads] [--transport pipe|ring] [--combine max_words] [--chunk-size bytes] [--stats=file] [--approx heavy_hitters] [--mem-limit bytes] [--index=file] [--base=file] [--stream [--snapshot-interval seconds] [--snapshot-tokens words]]\n", argv[0]);
         return 1;
     }
 
@@ -125,199 +1371,162 @@ int main(int argc, char *argv[]) {
     }
     fclose(test_fp);
 
-    if ((test_fp = fopen(input_file, "r")) == NULL) {
-        fprintf(stderr, "Error: Input file '%s' cannot be opened.\n", input_file);
-        perror("fopen input_file");
-        return 1;
+    // The streaming engine reads stdin with threads and writes its own output
+    if (stream_mode) {
+        if (have_input || stats_file || approx_capacity || mem_limit || index_file || base_file) {
+            fprintf(stderr, "Error: --stream reads standard input and cannot be combined with -i, --stats, --approx, --mem-limit, --index or --base.\n");
+            return 1;
+        }
+        if (use_threads || transport == TRANSPORT_RING || combine_limit > 0 || chunk_size > 0) {
+            fprintf(stderr, "Error: --stream always runs with threads and cannot be combined with --threads, --transport ring, --combine or --chunk-size.\n");
+            return 1;
+        }
+        return run_stream_pipeline(exclusion_file, output_file, top_k, routing, snapshot_interval,
+                                   snapshot_tokens) == -1 ? 1 : 0;
     }
-    fclose(test_fp);
-
-    // Set up signal handlers
-    signal(SIGUSR1, handle_usr1);
-    signal(SIGUSR2, handle_usr2);
-    // Allocate memory for PIDs and pipes
-    pid_t *builder_pids = malloc(num_builders * sizeof(pid_t));
-    pid_t *splitter_pids = malloc(num_splitters * sizeof(pid_t));
-    int **splitter_to_builder_pipes = malloc(num_builders * sizeof(int *));
-    int **builder_to_root_pipes = malloc(num_builders * sizeof(int *));
 
-    if (!builder_pids || !splitter_pids || !splitter_to_builder_pipes || !builder_to_root_pipes) {
-        perror("malloc");
+    if (inputs.count == 0) {
+        fprintf(stderr, "Error: No input files found.\n");
         return 1;
     }
 
-    // Allocate memory for start and end times of builders
-    struct timeval *builder_start_times = malloc(num_builders * sizeof(struct timeval));
-    struct timeval *builder_end_times = malloc(num_builders * sizeof(struct timeval));
-
-    if (!builder_start_times || !builder_end_times) {
-        perror("malloc");
+    // Spilling is done by builder processes, which count exactly
+    if (mem_limit > 0 && (use_threads || approx_capacity > 0)) {
+        fprintf(stderr, "Error: --mem-limit cannot be combined with --threads or --approx.\n");
         return 1;
     }
 
-    // Create pipes for each builder
-    for (int i = 0; i < num_builders; i++) {
-        splitter_to_builder_pipes[i] = malloc(2 * sizeof(int));
-        builder_to_root_pipes[i] = malloc(2 * sizeof(int));
-        if (!splitter_to_builder_pipes[i] || !builder_to_root_pipes[i]) {
-            perror("malloc");
-            return 1;
-        }
-
-        if (pipe(splitter_to_builder_pipes[i]) == -1 || pipe(builder_to_root_pipes[i]) == -1) {
-            perror("pipe");
-            return 1;
-        }
+    // The combiner and the rings belong to the splitter processes
+    if (use_threads && (combine_limit > 0 || transport == TRANSPORT_RING)) {
+        fprintf(stderr, "Error: --combine and --transport ring cannot be combined with --threads.\n");
+        return 1;
     }
 
-    // Create builders
-    for (int i = 0; i < num_builders; i++) {
-        builder_pids[i] = fork();
-        if (builder_pids[i] < 0) {
-            perror("fork builder");
-            return 1;
-        }
-        if (builder_pids[i] == 0) {
-            // Child process (builder)
-            // Redirect splitter_to_builder_pipes[i][0] to STDIN
-            if (dup2(splitter_to_builder_pipes[i][0], STDIN_FILENO) == -1) {
-                perror("dup2 STDIN");
-                return 1;
-            }
-            // Redirect builder_to_root_pipes[i][1] to STDOUT
-            if (dup2(builder_to_root_pipes[i][1], STDOUT_FILENO) == -1) {
-                perror("dup2 STDOUT");
-                return 1;
-            }
-
-            // Close all pipe file descriptors in the child
-            for (int j = 0; j < num_builders; j++) {
-                close(splitter_to_builder_pipes[j][0]);
-                close(splitter_to_builder_pipes[j][1]);
-                close(builder_to_root_pipes[j][0]);
-                close(builder_to_root_pipes[j][1]);
-            }
-
-            execl("./builder", "builder", NULL);
-            perror("execl builder");
-            return 1;
-        }
+    // An index holds exact counts of every word
+    if ((index_file || base_file) && approx_capacity > 0) {
+        fprintf(stderr, "Error: --index and --base cannot be combined with --approx.\n");
+        return 1;
     }
 
-    // Parent process: Close the read ends of splitter_to_builder_pipes and the write ends of builder_to_root_pipes
-    for (int i = 0; i < num_builders; i++) {
-        close(splitter_to_builder_pipes[i][0]);
-        close(builder_to_root_pipes[i][1]);
+    // Open the base index before counting, so a bad file fails fast
+    CountIndex base_index;
+    if (base_file && count_index_open(&base_index, base_file) == -1) {
+        fprintf(stderr, "Error: Could not open base index '%s'.\n", base_file);
+        perror("count_index_open");
+        return 1;
     }
 
-    // Create splitters
-    for (int i = 0; i < num_splitters; i++) {
-        splitter_pids[i] = fork();
-        if (splitter_pids[i] < 0) {
-            perror("fork splitter");
-            return 1;
-        }
-        if (splitter_pids[i] == 0) {
-            // Child process (splitter)
-            // Prepare pipe_fds_str
-            char pipe_fds_str[4096] = "";
-            for (int j = 0; j < num_builders; j++) {
-                char fd_str[12];
-                snprintf(fd_str, sizeof(fd_str), "%d ", splitter_to_builder_pipes[j][1]);
-                strcat(pipe_fds_str, fd_str);
-            }
-
-            // Convert splitter_id and num_builders to strings
-            char splitter_id_str[12], num_builders_str[12];
-            snprintf(splitter_id_str, sizeof(splitter_id_str), "%d", i);
-            snprintf(num_builders_str, sizeof(num_builders_str), "%d", num_builders);
+    // Every builder's list has to be able to hold the whole top_k
+    if (approx_capacity > 0 && approx_capacity < top_k) {
+        fprintf(stderr, "Error: --approx needs at least top_k (%d) heavy hitters per builder.\n", top_k);
+        return 1;
+    }
 
-            // Close unused file descriptors in the child
-            for (int j = 0; j < num_builders; j++) {
-                close(splitter_to_builder_pipes[j][0]);
-                close(builder_to_root_pipes[j][0]);
-                close(builder_to_root_pipes[j][1]);
-            }
+    double phase_start = stats_now();
+    RootStats root_stats = {
+        .engine = use_threads ? "threads" : "processes",
+        .transport = use_threads ? "queue" : transport == TRANSPORT_RING ? TRANSPORT_RING_NAME : TRANSPORT_PIPE_NAME,
+        .routing = routing == ROUTE_HASH ? ROUTING_HASH_NAME : ROUTING_ROUND_ROBIN_NAME,
+    };
 
-            execl("./splitter", "splitter", splitter_id_str, input_file, exclusion_file, num_builders_str, pipe_fds_str, NULL);
-            perror("execl splitter");
-            return 1;
-        }
+    // Divide the input files into chunks and publish them, largest first, in a shared
+    // queue (chunk_queue.h) that the splitters pull from until it runs dry
+    Chunk *planned_chunks;
+    ssize_t num_chunks = plan_input_chunks(&inputs, chunk_size, &planned_chunks);
+    if (num_chunks == -1) {
+        return 1;
     }
-
-    // Parent process: Close the write ends of splitter_to_builder_pipes, as they are handled by splitters
-    for (int i = 0; i < num_builders; i++) {
-        close(splitter_to_builder_pipes[i][1]);
+    const char **input_paths = malloc((inputs.count ? inputs.count : 1) * sizeof(char *));
+    if (!input_paths) {
+        perror("malloc");
+        return 1;
     }
-
-    // Wait for all splitters to finish
-    for (int i = 0; i < num_splitters; i++) {
-        while (waitpid(splitter_pids[i], NULL, 0) == -1 );
+    for (size_t i = 0; i < inputs.count; i++) {
+        input_paths[i] = inputs.files[i].path;
+    }
+    ChunkQueue chunks;
+    if (chunk_queue_create(&chunks, input_paths, inputs.count, planned_chunks, (size_t)num_chunks) == -1) {
+        perror("create chunk queue");
+        return 1;
+    }
+    free(input_paths);
+    free(planned_chunks);
+    root_stats.input_files = inputs.count;
+    root_stats.chunks = (uint64_t)num_chunks;
+    for (ssize_t i = 0; i < num_chunks; i++) {
+        root_stats.input_bytes += chunks.chunks[i].length;
     }
+    input_set_free(&inputs);
 
-    // Create the hash table
-    HashTable *hash_table = create_hash_table();
-    if (!hash_table) {
-        fprintf(stderr, "Failed to create hash table.\n");
+    // Shared slots where every splitter and builder leaves its counters (stats.h)
+    StatsRegion stats;
+    if (stats_region_create(&stats, num_splitters, num_builders) == -1) {
+        perror("create stats region");
         return 1;
     }
-    int total_words = 0;
-    int total_non_excluded_words = 0;
+    double now = stats_now();
+    root_stats.split_time = now - phase_start;
+    phase_start = now;
+
+    // With hash routing every builder owns a disjoint set of words, so the results
+    // are simply concatenated into word_array; with round-robin routing the same word
+    // arrives from several builders and has to be merged in the hash table.
+    BuilderResults results;
+    results.routing = routing;
+    results.hash_table = create_hash_table();
+    results.word_array = NULL;
+    results.total_words = 0;
+    results.word_array_capacity = 0;
+    arena_init(&results.word_array_keys, ARENA_BLOCK_SIZE);
+    results.total_non_excluded_words = 0;
+    results.approx_capacity = approx_capacity;
+    results.mem_limit = mem_limit;
+    results.all_words = index_file != NULL || base_file != NULL;
+    if (approx_capacity > 0) {
+        approx_merge_init(&results.approx, num_builders);
+    }
 
     // Allocate array to store elapsed times from builders
-    double *builder_elapsed_times = calloc(num_builders, sizeof(double));
-    if (!builder_elapsed_times) {
+    results.builder_elapsed_times = calloc(num_builders, sizeof(double));
+    if (!results.builder_elapsed_times) {
         perror("calloc builder_elapsed_times");
         return 1;
     }
 
-    // Collect results from builders
-    for (int i = 0; i < num_builders; i++) {
-        FILE *fp = fdopen(builder_to_root_pipes[i][0], "r");
-        if (!fp) {
-            perror("fdopen");
-            return 1;
-        }
-
-        char line[256];
-        while (fgets(line, sizeof(line), fp)) {
-            // Check if the line starts with "TIME"
-            if (strncmp(line, "TIME ", 5) == 0) {
-                double time_taken;
-                if (sscanf(line + 5, "%lf", &time_taken) == 1) {
-                    builder_elapsed_times[i] = time_taken;
-                } else {
-                    fprintf(stderr, "Builder %d sent malformed TIME line: %s", i, line);
-                }
-            } else {
-                // Process as word count
-                char word[100];
-                int count;
-                if (sscanf(line, "%s %d", word, &count) == 2) {
-                    insert_or_update_word(hash_table, word, count);
-                    total_non_excluded_words += count; // Update total word count
-                } else {
-                    fprintf(stderr, "Builder %d sent malformed word count line: %s", i, line);
-                }
-            }
-        }
-
-        fclose(fp); // Close the read-end of the pipe after reading
+    int status;
+    if (use_threads) {
+        status = run_thread_pipeline(exclusion_file, &chunks, &stats, top_k, &results);
+    } else {
+        status = run_process_pipeline(exclusion_file, &chunks, &stats, top_k, transport, combine_limit, &results);
     }
-
-    // Close all read ends of builder_to_root_pipes
-    for (int i = 0; i < num_builders; i++) {
-        close(builder_to_root_pipes[i][0]);
+    chunk_queue_unmap(&chunks);
+    if (status == 0 && base_file) {
+        if (merge_base_index(&base_index, &results) == -1) {
+            fprintf(stderr, "Error: Base index '%s' is corrupt.\n", base_file);
+            status = -1;
+        }
+        count_index_close(&base_index);
     }
-
-    // Wait for all builders to finish 
-    for (int i = 0; i < num_builders; i++) {
-        while (waitpid(builder_pids[i], NULL, 0) == -1 );
-
+    now = stats_now();
+    root_stats.merge_time = now - phase_start;
+    phase_start = now;
+    if (status == -1) {
+        return 1;
     }
+    HashTable *hash_table = results.hash_table;
+    size_t total_words = results.total_words;
+    uint64_t total_non_excluded_words = results.total_non_excluded_words;
+    double *builder_elapsed_times = results.builder_elapsed_times;
 
     // Calculate total unique words
-    total_words = hash_table->count;
+    // (sorted builder streams were merged into word_array, as with hash routing,
+    // unless a base index moved everything into the table)
+    int merged_in_table = (routing == ROUTE_ROUND_ROBIN && mem_limit == 0) || base_file != NULL;
+    if (approx_capacity > 0) {
+        total_words = results.approx.num_candidates;
+    } else if (merged_in_table) {
+        total_words = hash_table->count;
+    }
 
     if (total_words == 0) {
         fprintf(stderr, "No words to process.\n");
@@ -328,42 +1537,51 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         fclose(out_fp);
+        if (index_file && write_count_index(index_file, &results, merged_in_table) == -1) {
+            return 1;
+        }
 
-        // Free allocated resources before exiting
-        for (int i = 0; i < num_builders; i++) {
-            free(splitter_to_builder_pipes[i]);
-            free(builder_to_root_pipes[i]);
+        if (stats_file && write_run_stats(stats_file, &stats, &root_stats, run_start, total_non_excluded_words, 0) == -1) {
+            return 1;
         }
+        stats_region_unmap(&stats);
 
-        free(builder_pids);
-        free(splitter_pids);
-        free(splitter_to_builder_pipes);
-        free(builder_to_root_pipes);
+        // Free allocated resources before exiting
+        if (approx_capacity > 0) {
+            approx_merge_free(&results.approx);
+        }
+        arena_free(&results.word_array_keys);
+        free(results.word_array);
         free_hash_table(hash_table);
-        free(builder_start_times);
-        free(builder_end_times);
         free(builder_elapsed_times);
         return 0;
     }
 
-    // Create an array of WordCount pointers for sorting
-    WordCount **word_array = malloc(total_words * sizeof(WordCount *));
-    if (!word_array) {
-        perror("malloc word_array");
-        return 1;
-    }
-
-    int index = 0;
-    for (int i = 0; i < hash_table->size; i++) {
-        WordCount *node = hash_table->buckets[i];
-        while (node) {
-            word_array[index++] = node;
-            node = node->next;
+    // Select the top_k words with a bounded heap instead of sorting the whole vocabulary
+    // (--approx: bound the builders' heavy hitters and rank them by upper bound)
+    TopK top_words;
+    topk_init(&top_words, (size_t)top_k);
+    ApproxWord *approx_words = NULL;
+    size_t num_top_words;
+    if (approx_capacity > 0) {
+        num_top_words = approx_merge_finish(&results.approx, (size_t)top_k, &approx_words);
+    } else {
+        if (merged_in_table) {
+            size_t position = 0;
+            WordCount entry;
+            while (hash_table_next(hash_table, &position, &entry)) {
+                topk_offer(&top_words, entry.word, entry.count);
+            }
+        } else {
+            for (size_t i = 0; i < total_words; i++) {
+                topk_offer(&top_words, results.word_array[i].word, results.word_array[i].count);
+            }
         }
+        num_top_words = topk_finish(&top_words);
     }
-
-    // Sort the word_array based on counts in descending order
-    qsort(word_array, total_words, sizeof(WordCount *), compare_counts);
+    now = stats_now();
+    root_stats.sort_time = now - phase_start;
+    phase_start = now;
 
     // Write the top_k words to the output file with fraction format
     FILE *out_fp = fopen(output_file, "w");
@@ -372,11 +1590,36 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    for (int i = 0; i < top_k && i < total_words; i++) {
-        fprintf(out_fp, "%s: %d/%d\n", word_array[i]->word, word_array[i]->count, total_non_excluded_words);
-        printf("%s: %d/%d\n", word_array[i]->word, word_array[i]->count, total_non_excluded_words); // Also print to screen
+    for (size_t i = 0; i < num_top_words; i++) {
+        if (approx_words) {
+            // Approximate counts are upper bounds; the true count is at least the min
+            const ApproxWord *entry = &approx_words[i];
+            fprintf(out_fp, "%s: %" PRIu64 "/%" PRIu64 " (min %" PRIu64 ")\n", entry->word, entry->count,
+                    total_non_excluded_words, entry->lower);
+            printf("%s: %" PRIu64 "/%" PRIu64 " (min %" PRIu64 ")\n", entry->word, entry->count,
+                   total_non_excluded_words, entry->lower);
+            continue;
+        }
+        const WordCount *entry = &top_words.heap[i];
+        fprintf(out_fp, "%s: %" PRIu64 "/%" PRIu64 "\n", entry->word, entry->count, total_non_excluded_words);
+        printf("%s: %" PRIu64 "/%" PRIu64 "\n", entry->word, entry->count, total_non_excluded_words); // Also print to screen
     }
     fclose(out_fp);
+    topk_free(&top_words);
+    if (index_file && write_count_index(index_file, &results, merged_in_table) == -1) {
+        return 1;
+    }
+    if (approx_capacity > 0) {
+        const CountMinSketch *sketch = &results.approx.sketch;
+        printf("Approximate counts: %d heavy hitters and a %ux%u sketch per builder; "
+               "sketch error at most %.0f words with probability 1 - e^-%u.\n",
+               approx_capacity, sketch->depth, sketch->width,
+               sketch->width ? 2.718281828 / sketch->width * (double)total_non_excluded_words : 0.0,
+               sketch->depth);
+        free(approx_words);
+        approx_merge_free(&results.approx);
+    }
+    root_stats.write_time = stats_now() - phase_start;
 
     // Print the elapsed time reported by each builder
     for (int i = 0; i < num_builders; i++) {
@@ -407,20 +1650,24 @@ int main(int argc, char *argv[]) {
     printf("Run time was %lf sec (REAL time) although we used the CPU for %lf sec (CPU time).\n",
            real_time, cpu_time);
 
-    // Free allocated resources and close any open file descriptors
-    for (int i = 0; i < num_builders; i++) {
-        free(splitter_to_builder_pipes[i]);
-        free(builder_to_root_pipes[i]);
+    // With hash routing the root only saw each builder's top_k; the vocabulary is theirs combined.
+    // Once a base index was merged the table holds every word, including the base's own.
+    uint64_t distinct_words = total_words;
+    if (routing == ROUTE_HASH && !merged_in_table) {
+        distinct_words = 0;
+        for (int i = 0; i < num_builders; i++) {
+            distinct_words += stats.builders[i].distinct_words;
+        }
     }
+    if (stats_file && write_run_stats(stats_file, &stats, &root_stats, run_start, total_non_excluded_words, distinct_words) == -1) {
+        return 1;
+    }
+    stats_region_unmap(&stats);
 
-    free(builder_pids);
-    free(splitter_pids);
-    free(splitter_to_builder_pipes);
-    free(builder_to_root_pipes);
-    free(word_array);
+    // Free allocated resources
+    arena_free(&results.word_array_keys);
+    free(results.word_array);
     free_hash_table(hash_table);
-    free(builder_start_times);
-    free(builder_end_times);
     free(builder_elapsed_times);
 
     return 0;
@@ -1,10 +1,21 @@
 
 #include "hash_table.h"
+#include "splitter.h"
+#include "chunk_queue.h"
+#include "input_set.h"
+#include "decompress.h"
+#include "stats.h"
+#include "sketch.h"
+#include "count_index.h"
+#include "ring.h"
+#include "wire.h"
 #include <signal.h>
+#include <sys/types.h>
 
 /* Global Variables */
 extern volatile sig_atomic_t usr1_count;
 extern volatile sig_atomic_t usr2_count;
+extern volatile sig_atomic_t stop_requested;
 extern int num_splitters;
 extern int num_builders;
 
@@ -12,6 +23,71 @@ extern int num_builders;
 void handle_usr1(int sig);
 void handle_usr2(int sig);
 
+/* Input partitioning and result collection */
+int compute_input_splits(const char *path, int num_parts, off_t *offsets, off_t *lengths);
+off_t input_chunk_size(off_t total_size, off_t chunk_size);
+ssize_t plan_input_chunks(const InputSet *inputs, off_t chunk_size, Chunk **chunks);
+void append_word_count(WordCount **array, size_t *size, size_t *capacity, Arena *words,
+                       const char *word, size_t length, uint64_t count);
 
+/* Word counts collected from the builders, whichever engine ran them.
+ * With hash routing the builders own disjoint words and their results are
+ * concatenated into word_array; with round-robin routing they are merged in
+ * hash_table. Approximate builders (--approx) send sketches and heavy hitters
+ * instead, which are merged in approx. Builders with a memory limit
+ * (--mem-limit) send their words in word order, so with round-robin routing
+ * the root merges the sorted streams into word_array instead of hashing. */
+typedef struct BuilderResults {
+    RoutingMode routing;
+    HashTable *hash_table;
+    WordCount *word_array;
+    size_t total_words;
+    size_t word_array_capacity;
+    Arena word_array_keys;              /* owns the words of word_array */
+    uint64_t total_non_excluded_words;
+    double *builder_elapsed_times;
+    int approx_capacity;                /* heavy hitters per builder, 0 for exact counts */
+    ApproxMerge approx;                 /* valid when approx_capacity > 0 */
+    uint64_t mem_limit;                 /* bytes per builder before spilling, 0 for none */
+    int all_words;                      /* builders send every word, not their top_k (--index, --base) */
+} BuilderResults;
 
+/* Child processes the root checks on while it waits for builder results. With
+ * the ring transport it closes the rings of splitters that have exited and
+ * abandons the rings of builders that have exited, since no kernel object
+ * reports either to the other side. */
+typedef struct ChildReaper {
+    pid_t *splitter_pids;
+    int *splitter_reaped;
+    pid_t *builder_pids;
+    int *builder_reaped;
+    RingRegion *rings;                  /* NULL with the pipe transport */
+    int *splitter_events;
+    int *builder_events;
+    int *builder_trailers;              /* builders whose result stream reached its trailer */
+    int *builder_failed;                /* builders that exited with an error or sent a broken stream */
+    int failed;                         /* splitters that exited with an error */
+} ChildReaper;
 
+/* Counting engines */
+void record_splitter_exit(ChildReaper *reaper, int i, int child_status);
+void record_builder_exit(ChildReaper *reaper, int i, int child_status);
+void abandon_builder_rings(ChildReaper *reaper, int i);
+void reap_children(ChildReaper *reaper);
+void add_builder_count(BuilderResults *results, const char *word, size_t length, uint64_t count);
+int merge_sorted_builder_results(WireReader *readers, BuilderResults *results, ChildReaper *reaper,
+                                 int poll_timeout);
+int run_process_pipeline(const char *exclusion_file, ChunkQueue *chunks,
+                         StatsRegion *stats, int top_k, Transport transport, int combine_limit,
+                         BuilderResults *results);
+int run_thread_pipeline(const char *exclusion_file, ChunkQueue *chunks,
+                        StatsRegion *stats, int top_k, BuilderResults *results);
+void handle_stop(int sig);
+void write_snapshot(const WordCount *top, size_t count, uint64_t total_words, uint64_t snapshot,
+                    int final, void *context);
+int run_stream_pipeline(const char *exclusion_file, const char *output_file, int top_k, RoutingMode routing,
+                        double snapshot_interval, uint64_t snapshot_tokens);
+int merge_base_index(const CountIndex *base, BuilderResults *results);
+int write_count_index(const char *path, const BuilderResults *results, int merged_in_table);
+int write_run_stats(const char *path, const StatsRegion *stats, RootStats *root, double run_start,
+                    uint64_t total_tokens, uint64_t distinct_words);
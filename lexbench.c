@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*
+ * Benchmark driver behind make bench.
+ *
+ * For every input size it generates a corpus with ./corpusgen (or uses the
+ * given input), then runs ./lexan for every combination of splitter and
+ * builder counts, several times each. Every run becomes one CSV row or JSON
+ * object with its wall and CPU time, throughput, peak RSS of the whole
+ * process tree and the time spent in the slowest builder versus the rest
+ * of the pipeline (startup, splitting, merging and writing).
+ */
+
+#define MAX_LIST 32
+#define MAX_ARGS 64
+#define PATH_SIZE 4096
+
+typedef struct RunResult {
+    double wall_time;
+    double user_time;
+    double sys_time;
+    long peak_rss_kb;           /* largest resident set among lexan and its children */
+    double builder_time;        /* slowest builder's reported time */
+    unsigned long long tokens;  /* non-excluded words counted by lexan */
+    int exit_status;
+} RunResult;
+
+typedef struct Bench {
+    int splitters[MAX_LIST], num_splitter_counts;
+    int builders[MAX_LIST], num_builder_counts;
+    char *sizes[MAX_LIST];
+    int num_sizes;
+    int repeats;
+    int top_k;
+    int json;
+    const char *work_dir;
+    const char *corpus_args[MAX_ARGS];  /* passed through to corpusgen */
+    int num_corpus_args;
+    char **lexan_args;                  /* extra lexan options after -- */
+    int num_lexan_args;
+    FILE *out;
+    int rows;
+} Bench;
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-s sizes] [-l splitters] [-m builders] [-r repeats] [-t top_k] [-f csv|json] "
+                    "[-o output_file] [-d work_dir] [-i input_file -e exclusion_file] "
+                    "[-v vocabulary] [-z skew] [-w words_per_line] [-x exclusion_ratio] [-S seed] [-- lexan options]\n"
+                    "Lists are comma separated, e.g. -l 1,2,4 -s 8M,64M\n", program);
+}
+
+/* Split a comma-separated list in place */
+static int parse_list(char *text, char **items, int max_items) {
+    int count = 0;
+    for (char *item = strtok(text, ","); item; item = strtok(NULL, ",")) {
+        if (count == max_items) {
+            return -1;
+        }
+        items[count++] = item;
+    }
+    return count;
+}
+
+static int parse_int_list(char *text, int *values, int max_values) {
+    char *items[MAX_LIST];
+    int count = parse_list(text, items, max_values < MAX_LIST ? max_values : MAX_LIST);
+    for (int i = 0; i < count; i++) {
+        values[i] = atoi(items[i]);
+        if (values[i] <= 0) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+static double seconds_between(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Run a program with stdout redirected to stdout_path and wait for it, collecting
+ * the resource usage of it and every child it waited for */
+static int run_program(const char *path, char *const argv[], const char *stdout_path, RunResult *result) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int fd = stdout_path ? open(stdout_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : dup(STDERR_FILENO);
+        if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1) {
+            perror("redirect stdout");
+            _exit(127);
+        }
+        close(fd);
+        execv(path, argv);
+        perror(path);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) == -1) {
+        if (errno != EINTR) {
+            perror("wait4");
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (result) {
+        result->wall_time = seconds_between(&start, &end);
+        result->user_time = (double)usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        result->sys_time = (double)usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        result->peak_rss_kb = usage.ru_maxrss;
+        result->exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/* Pick the slowest builder time out of lexan's report */
+static double read_builder_time(const char *stdout_path) {
+    FILE *fp = fopen(stdout_path, "r");
+    if (!fp) {
+        return 0;
+    }
+    char line[4096];
+    double slowest = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        int id;
+        double elapsed;
+        if (sscanf(line, "Builder %d completed in %lf", &id, &elapsed) == 2 && elapsed > slowest) {
+            slowest = elapsed;
+        }
+    }
+    fclose(fp);
+    return slowest;
+}
+
+/* The denominator of every output line is the number of non-excluded words */
+static unsigned long long read_token_count(const char *output_path) {
+    FILE *fp = fopen(output_path, "r");
+    if (!fp) {
+        return 0;
+    }
+    char line[4096];
+    unsigned long long tokens = 0;
+    if (fgets(line, sizeof(line), fp)) {
+        char *slash = strrchr(line, '/');
+        if (slash) {
+            tokens = strtoull(slash + 1, NULL, 10);
+        }
+    }
+    fclose(fp);
+    return tokens;
+}
+
+static void write_header(Bench *bench) {
+    if (bench->json) {
+        fprintf(bench->out, "[\n");
+    } else {
+        fprintf(bench->out, "input,input_bytes,splitters,builders,run,exit_status,wall_s,user_s,sys_s,"
+                            "mb_per_s,tokens,tokens_per_s,peak_rss_kb,builder_s,rest_s\n");
+    }
+}
+
+static void write_row(Bench *bench, const char *input, long long input_bytes, int splitters, int builders,
+                      int run, const RunResult *result) {
+    double mb_per_s = result->wall_time > 0 ? input_bytes / (1024.0 * 1024.0) / result->wall_time : 0;
+    double tokens_per_s = result->wall_time > 0 ? result->tokens / result->wall_time : 0;
+    double rest_time = result->wall_time - result->builder_time;
+    if (bench->json) {
+        fprintf(bench->out,
+                "%s  {\"input\": \"%s\", \"input_bytes\": %lld, \"splitters\": %d, \"builders\": %d, \"run\": %d, "
+                "\"exit_status\": %d, \"wall_s\": %.6f, \"user_s\": %.6f, \"sys_s\": %.6f, \"mb_per_s\": %.3f, "
+                "\"tokens\": %llu, \"tokens_per_s\": %.0f, \"peak_rss_kb\": %ld, \"builder_s\": %.6f, \"rest_s\": %.6f}",
+                bench->rows ? ",\n" : "", input, input_bytes, splitters, builders, run, result->exit_status,
+                result->wall_time, result->user_time, result->sys_time, mb_per_s, result->tokens, tokens_per_s,
+                result->peak_rss_kb, result->builder_time, rest_time);
+    } else {
+        fprintf(bench->out, "%s,%lld,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.3f,%llu,%.0f,%ld,%.6f,%.6f\n", input, input_bytes,
+                splitters, builders, run, result->exit_status, result->wall_time, result->user_time,
+                result->sys_time, mb_per_s, result->tokens, tokens_per_s, result->peak_rss_kb,
+                result->builder_time, rest_time);
+    }
+    fflush(bench->out);
+    bench->rows++;
+}
+
+static void write_footer(Bench *bench) {
+    if (bench->json) {
+        fprintf(bench->out, "%s]\n", bench->rows ? "\n" : "");
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sweep every splitter and builder count over one input */
+static int bench_input(Bench *bench, const char *input_file, const char *exclusion_file, const char *label) {
+    struct stat st;
+    if (stat(input_file, &st) == -1) {
+        perror(input_file);
+        return -1;
+    }
+
+    char output_path[PATH_SIZE], stdout_path[PATH_SIZE];
+    snprintf(output_path, sizeof(output_path), "%s/output.txt", bench->work_dir);
+    snprintf(stdout_path, sizeof(stdout_path), "%s/stdout.txt", bench->work_dir);
+
+    for (int l = 0; l < bench->num_splitter_counts; l++) {
+        for (int m = 0; m < bench->num_builder_counts; m++) {
+            char splitters_str[12], builders_str[12], top_k_str[12];
+            snprintf(splitters_str, sizeof(splitters_str), "%d", bench->splitters[l]);
+            snprintf(builders_str, sizeof(builders_str), "%d", bench->builders[m]);
+            snprintf(top_k_str, sizeof(top_k_str), "%d", bench->top_k);
+
+            char *argv[MAX_ARGS + 16];
+            int argc = 0;
+            argv[argc++] = "lexan";
+            argv[argc++] = "-i"; argv[argc++] = (char *)input_file;
+            argv[argc++] = "-l"; argv[argc++] = splitters_str;
+            argv[argc++] = "-m"; argv[argc++] = builders_str;
+            argv[argc++] = "-t"; argv[argc++] = top_k_str;
+            argv[argc++] = "-e"; argv[argc++] = (char *)exclusion_file;
+            argv[argc++] = "-o"; argv[argc++] = output_path;
+            for (int i = 0; i < bench->num_lexan_args && argc < MAX_ARGS + 15; i++) {
+                argv[argc++] = bench->lexan_args[i];
+            }
+            argv[argc] = NULL;
+
+            double wall_times[bench->repeats];
+            for (int run = 0; run < bench->repeats; run++) {
+                RunResult result = { 0 };
+                run_program("./lexan", argv, stdout_path, &result);
+                result.builder_time = read_builder_time(stdout_path);
+                result.tokens = result.exit_status == 0 ? read_token_count(output_path) : 0;
+                write_row(bench, label, (long long)st.st_size, bench->splitters[l], bench->builders[m], run, &result);
+                wall_times[run] = result.exit_status == 0 ? result.wall_time : 0;
+            }
+
+            qsort(wall_times, bench->repeats, sizeof(double), compare_doubles);
+            double median = wall_times[bench->repeats / 2];
+            fprintf(stderr, "%-12s -l %-3d -m %-3d median %.3f s, %.1f MB/s\n", label, bench->splitters[l],
+                    bench->builders[m], median, median > 0 ? st.st_size / (1024.0 * 1024.0) / median : 0);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Bench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.repeats = 3;
+    bench.top_k = 10;
+    bench.work_dir = "bench_data";
+    bench.out = stdout;
+
+    char default_splitters[] = "1,2,4", default_builders[] = "1,2,4", default_sizes[] = "8M,32M";
+    char *splitter_list = default_splitters, *builder_list = default_builders, *size_list = default_sizes;
+    const char *input_file = NULL, *exclusion_file = NULL, *output_file = NULL;
+
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            bench.lexan_args = &argv[i + 1];
+            bench.num_lexan_args = argc - i - 1;
+            break;
+        }
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        char flag = argv[i][1];
+        char *value = argv[++i];
+        switch (flag) {
+            case 'l': splitter_list = value; break;
+            case 'm': builder_list = value; break;
+            case 's': size_list = value; break;
+            case 'r': bench.repeats = atoi(value); break;
+            case 't': bench.top_k = atoi(value); break;
+            case 'f':
+                if (strcmp(value, "json") == 0) {
+                    bench.json = 1;
+                } else if (strcmp(value, "csv") != 0) {
+                    fprintf(stderr, "Unknown format: %s\n", value);
+                    return 1;
+                }
+                break;
+            case 'o': output_file = value; break;
+            case 'd': bench.work_dir = value; break;
+            case 'i': input_file = value; break;
+            case 'e': exclusion_file = value; break;
+            case 'v': case 'z': case 'w': case 'x': case 'S':
+                if (bench.num_corpus_args + 2 > MAX_ARGS) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                bench.corpus_args[bench.num_corpus_args++] = argv[i - 1];
+                bench.corpus_args[bench.num_corpus_args++] = value;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    bench.num_splitter_counts = parse_int_list(splitter_list, bench.splitters, MAX_LIST);
+    bench.num_builder_counts = parse_int_list(builder_list, bench.builders, MAX_LIST);
+    bench.num_sizes = parse_list(size_list, bench.sizes, MAX_LIST);
+    if (bench.num_splitter_counts <= 0 || bench.num_builder_counts <= 0 || bench.num_sizes <= 0 ||
+        bench.repeats <= 0 || bench.top_k <= 0 || (input_file && !exclusion_file)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (mkdir(bench.work_dir, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir work_dir");
+        return 1;
+    }
+    if (output_file) {
+        bench.out = fopen(output_file, "w");
+        if (!bench.out) {
+            perror("fopen output_file");
+            return 1;
+        }
+    }
+
+    write_header(&bench);
+    int status = 0;
+    if (input_file) {
+        status = bench_input(&bench, input_file, exclusion_file, input_file);
+    } else {
+        for (int s = 0; s < bench.num_sizes && status == 0; s++) {
+            char corpus_path[PATH_SIZE], exclusion_path[PATH_SIZE];
+            snprintf(corpus_path, sizeof(corpus_path), "%s/corpus_%s.txt", bench.work_dir, bench.sizes[s]);
+            snprintf(exclusion_path, sizeof(exclusion_path), "%s/exclusion_%s.txt", bench.work_dir, bench.sizes[s]);
+
+            // Generated with a fixed seed, so every sweep measures the same text
+            char *gen_argv[MAX_ARGS + 8];
+            int gen_argc = 0;
+            gen_argv[gen_argc++] = "corpusgen";
+            gen_argv[gen_argc++] = "-s"; gen_argv[gen_argc++] = bench.sizes[s];
+            gen_argv[gen_argc++] = "-o"; gen_argv[gen_argc++] = corpus_path;
+            gen_argv[gen_argc++] = "-e"; gen_argv[gen_argc++] = exclusion_path;
+            for (int a = 0; a < bench.num_corpus_args; a++) {
+                gen_argv[gen_argc++] = (char *)bench.corpus_args[a];
+            }
+            gen_argv[gen_argc] = NULL;
+            if (run_program("./corpusgen", gen_argv, NULL, NULL) == -1) {
+                fprintf(stderr, "Error: Could not generate a corpus of size %s.\n", bench.sizes[s]);
+                status = -1;
+                break;
+            }
+            status = bench_input(&bench, corpus_path, exclusion_path, bench.sizes[s]);
+        }
+    }
+    write_footer(&bench);
+
+    if (output_file) {
+        fclose(bench.out);
+    }
+    return status == -1 ? 1 : 0;
+}
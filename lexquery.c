@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "count_index.h"
+
+/* Answer queries against an index written by lexan --index (see count_index.h).
+ * Queries run in the order given; every answer is printed as word: count/total. */
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s index_file [-w word]... [-p prefix]... [-t k]... [-n max_prefix_matches] [-v]\n",
+            program);
+}
+
+static double now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e6 + (double)now.tv_nsec / 1e3;
+}
+
+static void print_entry(const CountIndex *index, size_t i) {
+    size_t length;
+    const char *word = count_index_word(index, i, &length);
+    printf("%s: %" PRIu64 "/%" PRIu64 "\n", word, index->counts[i], index->header->total_count);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return 1;
+    }
+    CountIndex index;
+    if (count_index_open(&index, argv[1]) == -1) {
+        fprintf(stderr, "Error: Could not open index '%s'.\n", argv[1]);
+        perror("count_index_open");
+        return 1;
+    }
+    size_t num_words = (size_t)index.header->num_words;
+
+    // -v and -n apply to every query wherever they appear, so pick them out first;
+    // the other options are skipped together with their values
+    int verbose = 0;
+    size_t max_matches = SIZE_MAX;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (i + 1 < argc) {
+            if (strcmp(argv[i], "-n") == 0) {
+                max_matches = (size_t)strtoull(argv[i + 1], NULL, 10);
+            }
+            i++;
+        }
+    }
+    int queries = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            continue;
+        }
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i + 1 >= argc) {
+            usage(argv[0]);
+            count_index_close(&index);
+            return 1;
+        }
+        const char *value = argv[++i];
+        size_t length = strlen(value);
+        double start = now_us();
+        switch (argv[i - 1][1]) {
+            case 'w': {
+                // Point lookup; unknown words count 0
+                size_t position;
+                if (count_index_find(&index, value, length, &position)) {
+                    print_entry(&index, position);
+                } else {
+                    printf("%s: 0/%" PRIu64 "\n", value, index.header->total_count);
+                }
+                break;
+            }
+            case 'p': {
+                // Every word starting with the prefix, in sorted order
+                size_t matches = 0;
+                for (size_t position = count_index_lower_bound(&index, value, length);
+                     position < num_words && matches < max_matches; position++, matches++) {
+                    size_t word_length;
+                    const char *word = count_index_word(&index, position, &word_length);
+                    if (word_length < length || memcmp(word, value, length) != 0) {
+                        break;
+                    }
+                    print_entry(&index, position);
+                }
+                break;
+            }
+            case 't': {
+                // The k most frequent words, straight from the rank table
+                size_t k = (size_t)strtoull(value, NULL, 10);
+                for (size_t rank = 0; rank < k && rank < num_words; rank++) {
+                    print_entry(&index, index.ranks[rank]);
+                }
+                break;
+            }
+            case 'n':
+                continue;
+            default:
+                usage(argv[0]);
+                count_index_close(&index);
+                return 1;
+        }
+        queries++;
+        if (verbose) {
+            fprintf(stderr, "%s %s: %.1f us\n", argv[i - 1], value, now_us() - start);
+        }
+    }
+
+    if (queries == 0) {
+        printf("%zu words, %" PRIu64 " in total, %zu bytes.\n", num_words, index.header->total_count, index.size);
+    }
+    count_index_close(&index);
+    return 0;
+}
@@ -0,0 +1,191 @@
+/* ring.c */
+
+#define _GNU_SOURCE
+#include "ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+/* Each ring's header gets its own page, followed by the data */
+#define RING_HEADER_SPACE 4096
+
+static size_t ring_stride(size_t capacity) {
+    return RING_HEADER_SPACE + capacity;
+}
+
+/* Create and map a zeroed region with one ring per splitter -> builder edge */
+int ring_region_create(RingRegion *region, int num_splitters, int num_builders, size_t capacity) {
+    region->num_splitters = num_splitters;
+    region->num_builders = num_builders;
+    region->capacity = capacity;
+    region->size = (size_t)num_splitters * num_builders * ring_stride(capacity);
+
+    region->fd = memfd_create("lexan-rings", 0);
+    if (region->fd == -1) {
+        return -1;
+    }
+    if (ftruncate(region->fd, (off_t)region->size) == -1) {
+        close(region->fd);
+        return -1;
+    }
+    region->base = mmap(NULL, region->size, PROT_READ | PROT_WRITE, MAP_SHARED, region->fd, 0);
+    if (region->base == MAP_FAILED) {
+        close(region->fd);
+        return -1;
+    }
+    return 0;
+}
+
+/* Map a region created by another process from its spec string */
+int ring_region_map(RingRegion *region, const char *spec) {
+    unsigned long long capacity;
+    if (sscanf(spec, "%d:%d:%d:%llu", &region->fd, &region->num_splitters, &region->num_builders, &capacity) != 4 ||
+        region->num_splitters <= 0 || region->num_builders <= 0 || capacity == 0 || (capacity & (capacity - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+    region->capacity = (size_t)capacity;
+    region->size = (size_t)region->num_splitters * region->num_builders * ring_stride(region->capacity);
+    region->base = mmap(NULL, region->size, PROT_READ | PROT_WRITE, MAP_SHARED, region->fd, 0);
+    if (region->base == MAP_FAILED) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Describe the region for ring_region_map in a child process */
+void ring_region_spec(const RingRegion *region, char *spec, size_t size) {
+    snprintf(spec, size, "%d:%d:%d:%llu", region->fd, region->num_splitters, region->num_builders,
+             (unsigned long long)region->capacity);
+}
+
+/* Unmap the region and close its descriptor */
+void ring_region_unmap(RingRegion *region) {
+    munmap(region->base, region->size);
+    close(region->fd);
+    region->base = NULL;
+    region->fd = -1;
+}
+
+/* Attach to the ring of the splitter -> builder edge */
+void ring_attach(Ring *ring, const RingRegion *region, int splitter, int builder, int wait_fd, int wake_fd) {
+    char *slot = (char *)region->base + ((size_t)splitter * region->num_builders + builder) * ring_stride(region->capacity);
+    ring->header = (RingHeader *)slot;
+    ring->data = slot + RING_HEADER_SPACE;
+    ring->mask = region->capacity - 1;
+    ring->wait_fd = wait_fd;
+    ring->wake_fd = wake_fd;
+}
+
+/* Add one to the other side's eventfd */
+static void ring_signal(int event_fd) {
+    uint64_t one = 1;
+    while (write(event_fd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+/* Sleep until the eventfd has been signalled, consuming the signal */
+int ring_wait(int event_fd) {
+    uint64_t value;
+    ssize_t n;
+    do {
+        n = read(event_fd, &value, sizeof(value));
+    } while (n == -1 && errno == EINTR);
+    return n == -1 ? -1 : 0;
+}
+
+/* Producer: append all bytes, sleeping while the ring is full.
+ * Returns 0, or -1 with errno EPIPE once the consumer has abandoned the ring. */
+int ring_write(Ring *ring, const void *data, size_t length) {
+    RingHeader *header = ring->header;
+    const char *bytes = data;
+    uint64_t capacity = ring->mask + 1;
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+
+    while (length > 0) {
+        if (atomic_load(&header->abandoned)) {
+            errno = EPIPE;
+            return -1;
+        }
+        uint64_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+        uint64_t space = capacity - (head - tail);
+        if (space == 0) {
+            /* Announce the wait, then look again so a concurrent read cannot be missed */
+            atomic_store(&header->producer_waiting, 1);
+            if (atomic_load(&header->tail) == tail) {
+                if (ring_wait(ring->wait_fd) == -1) {
+                    return -1;
+                }
+            }
+            continue;
+        }
+
+        size_t chunk = length < space ? length : (size_t)space;
+        size_t offset = (size_t)(head & ring->mask);
+        size_t first = chunk < capacity - offset ? chunk : (size_t)(capacity - offset);
+        memcpy(ring->data + offset, bytes, first);
+        memcpy(ring->data, bytes + first, chunk - first);
+        head += chunk;
+        bytes += chunk;
+        length -= chunk;
+
+        atomic_store(&header->head, head);
+        if (atomic_load(&header->consumer_waiting) && atomic_exchange(&header->consumer_waiting, 0)) {
+            ring_signal(ring->wake_fd);
+        }
+    }
+    return 0;
+}
+
+/* Consumer: copy out up to length bytes without blocking.
+ * Returns the number of bytes, 0 once the producer has closed an empty ring,
+ * or -1 with errno EAGAIN when empty. An EAGAIN result guarantees that the
+ * producer signals wait_fd after its next write or close. */
+ssize_t ring_read(Ring *ring, void *buffer, size_t length) {
+    RingHeader *header = ring->header;
+    uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+
+    if (head == tail) {
+        atomic_store(&header->consumer_waiting, 1);
+        /* closed is read before head: the producer publishes its last bytes before closing */
+        int closed = atomic_load(&header->closed);
+        head = atomic_load(&header->head);
+        if (head == tail) {
+            if (closed) {
+                return 0;
+            }
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    uint64_t capacity = ring->mask + 1;
+    size_t chunk = head - tail < length ? (size_t)(head - tail) : length;
+    size_t offset = (size_t)(tail & ring->mask);
+    size_t first = chunk < capacity - offset ? chunk : (size_t)(capacity - offset);
+    memcpy(buffer, ring->data + offset, first);
+    memcpy((char *)buffer + first, ring->data, chunk - first);
+
+    atomic_store(&header->tail, tail + chunk);
+    if (atomic_load(&header->producer_waiting) && atomic_exchange(&header->producer_waiting, 0)) {
+        ring_signal(ring->wake_fd);
+    }
+    return (ssize_t)chunk;
+}
+
+/* Producer (or the root on its behalf): no more data will follow */
+void ring_close(Ring *ring) {
+    atomic_store(&ring->header->closed, 1);
+    atomic_store(&ring->header->consumer_waiting, 0);
+    ring_signal(ring->wake_fd);
+}
+
+/* The root on behalf of a consumer that has exited: the producer stops writing.
+ * The signal is unconditional, so a producer that is about to sleep wakes up. */
+void ring_abandon(Ring *ring) {
+    atomic_store(&ring->header->abandoned, 1);
+    ring_signal(ring->wake_fd);
+}
@@ -0,0 +1,83 @@
+/* ring.h */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/*
+ * Shared-memory transport between splitters and builders (lexan --transport ring).
+ *
+ * One memfd holds a single-producer/single-consumer byte ring for every
+ * splitter -> builder edge. Both sides map it, so frames are copied straight
+ * into the consumer's view of the ring without passing through the kernel.
+ * The producer advances head and the consumer advances tail; both are
+ * monotonic byte counters, so the ring is empty when they are equal.
+ *
+ * Wakeups go through eventfds and are only needed at the edges: a consumer
+ * that finds a ring empty raises consumer_waiting before sleeping on its own
+ * eventfd, and the producer only signals after publishing if that flag was
+ * set. The producer does the same with producer_waiting when the ring is
+ * full. Each builder has one eventfd shared by all its input rings, and each
+ * splitter one eventfd shared by all its output rings.
+ *
+ * If a builder dies, nothing closes its end of the rings, so the root marks
+ * them abandoned (ring_abandon); the producer then fails with EPIPE instead of
+ * waiting forever for space, as it would on a pipe with no reader.
+ *
+ * The region is described to child processes by a spec string
+ * "fd:num_splitters:num_builders:capacity".
+ */
+
+#define RING_CAPACITY (1024 * 1024)     /* bytes per edge, a power of two */
+#define RING_SPEC_SIZE 64
+
+typedef struct RingHeader {
+    _Atomic uint64_t head;              /* bytes written by the producer */
+    char head_pad[56];
+    _Atomic uint64_t tail;              /* bytes consumed by the consumer */
+    char tail_pad[56];
+    _Atomic uint32_t closed;            /* the producer will not write again */
+    _Atomic uint32_t producer_waiting;
+    _Atomic uint32_t consumer_waiting;
+    _Atomic uint32_t abandoned;         /* the consumer will not read again */
+    char flags_pad[48];
+} RingHeader;
+
+/* Every edge's ring in one shared mapping */
+typedef struct RingRegion {
+    int fd;
+    void *base;
+    size_t size;
+    int num_splitters;
+    int num_builders;
+    size_t capacity;
+} RingRegion;
+
+/* One side's handle on the ring of an edge */
+typedef struct Ring {
+    RingHeader *header;
+    char *data;
+    uint64_t mask;
+    int wait_fd;                        /* eventfd this side sleeps on */
+    int wake_fd;                        /* eventfd of the other side */
+} Ring;
+
+/* Region Functions */
+int ring_region_create(RingRegion *region, int num_splitters, int num_builders, size_t capacity);
+int ring_region_map(RingRegion *region, const char *spec);
+void ring_region_spec(const RingRegion *region, char *spec, size_t size);
+void ring_region_unmap(RingRegion *region);
+
+/* Ring Functions */
+void ring_attach(Ring *ring, const RingRegion *region, int splitter, int builder, int wait_fd, int wake_fd);
+int ring_write(Ring *ring, const void *data, size_t length);
+ssize_t ring_read(Ring *ring, void *buffer, size_t length);
+void ring_close(Ring *ring);
+void ring_abandon(Ring *ring);
+int ring_wait(int event_fd);
+
+#endif
@@ -0,0 +1,384 @@
+/* sketch.c */
+
+#include "sketch.h"
+#include "hash_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Column of a word in one row: the rows take independent mixes of the
+ * word's hash, so they do not share the bits used to pick its builder */
+static inline size_t sketch_column(const CountMinSketch *sketch, uint64_t hash, uint32_t row) {
+    uint64_t x = hash + (uint64_t)(row + 1) * 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return (size_t)row * sketch->width + (size_t)(x & (sketch->width - 1));
+}
+
+/* Initialize a zeroed sketch; width must be a power of two */
+void sketch_init(CountMinSketch *sketch, uint32_t depth, uint32_t width) {
+    sketch->depth = depth;
+    sketch->width = width;
+    sketch->counters = calloc((size_t)depth * width, sizeof(uint64_t));
+    if (!sketch->counters) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Add count occurrences of the word with this hash */
+void sketch_add(CountMinSketch *sketch, uint64_t hash, uint64_t count) {
+    for (uint32_t row = 0; row < sketch->depth; row++) {
+        sketch->counters[sketch_column(sketch, hash, row)] += count;
+    }
+}
+
+/* Smallest counter of the word over all rows, never below its true count */
+uint64_t sketch_estimate(const CountMinSketch *sketch, uint64_t hash) {
+    uint64_t estimate = UINT64_MAX;
+    for (uint32_t row = 0; row < sketch->depth; row++) {
+        uint64_t value = sketch->counters[sketch_column(sketch, hash, row)];
+        if (value < estimate) {
+            estimate = value;
+        }
+    }
+    return estimate;
+}
+
+void sketch_free(CountMinSketch *sketch) {
+    free(sketch->counters);
+    sketch->counters = NULL;
+}
+
+/* Sketch width that goes with a list of capacity heavy hitters */
+uint32_t sketch_width_for(size_t capacity) {
+    uint32_t width = SKETCH_MIN_WIDTH;
+    while (width < capacity * SKETCH_WIDTH_PER_ENTRY && width < (1u << 30)) {
+        width <<= 1;
+    }
+    return width;
+}
+
+/* Initialize an empty list of at most capacity words */
+void space_saving_init(SpaceSaving *list, size_t capacity) {
+    size_t index_size = 16;
+    while (index_size < 2 * capacity) {
+        index_size <<= 1;
+    }
+    list->size = 0;
+    list->capacity = capacity;
+    list->entries = calloc(capacity, sizeof(HeavyHitter));
+    list->heap = malloc(capacity * sizeof(size_t));
+    list->heap_position = malloc(capacity * sizeof(size_t));
+    list->index = calloc(index_size, sizeof(size_t));
+    list->index_mask = index_size - 1;
+    if (!list->entries || !list->heap || !list->heap_position || !list->index) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void heap_swap(SpaceSaving *list, size_t a, size_t b) {
+    size_t entry = list->heap[a];
+    list->heap[a] = list->heap[b];
+    list->heap[b] = entry;
+    list->heap_position[list->heap[a]] = a;
+    list->heap_position[list->heap[b]] = b;
+}
+
+static void heap_sift_up(SpaceSaving *list, size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (list->entries[list->heap[parent]].count <= list->entries[list->heap[i]].count) {
+            return;
+        }
+        heap_swap(list, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_sift_down(SpaceSaving *list, size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < list->size && list->entries[list->heap[left]].count < list->entries[list->heap[smallest]].count) {
+            smallest = left;
+        }
+        if (right < list->size && list->entries[list->heap[right]].count < list->entries[list->heap[smallest]].count) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        heap_swap(list, i, smallest);
+        i = smallest;
+    }
+}
+
+/* Index slot holding the word, or the empty slot where it would go */
+static size_t index_find(const SpaceSaving *list, const char *word, size_t length, uint64_t hash) {
+    size_t slot = (size_t)hash & list->index_mask;
+    while (list->index[slot]) {
+        const HeavyHitter *entry = &list->entries[list->index[slot] - 1];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->word, word, length) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & list->index_mask;
+    }
+    return slot;
+}
+
+/* Remove an entry from the index, shifting later entries of its probe run back */
+static void index_remove(SpaceSaving *list, size_t entry_index) {
+    const HeavyHitter *entry = &list->entries[entry_index];
+    size_t hole = index_find(list, entry->word, entry->length, entry->hash);
+    size_t slot = hole;
+    for (;;) {
+        slot = (slot + 1) & list->index_mask;
+        if (!list->index[slot]) {
+            break;
+        }
+        size_t home = (size_t)list->entries[list->index[slot] - 1].hash & list->index_mask;
+        if (((slot - home) & list->index_mask) >= ((slot - hole) & list->index_mask)) {
+            list->index[hole] = list->index[slot];
+            hole = slot;
+        }
+    }
+    list->index[hole] = 0;
+}
+
+static void entry_set_word(HeavyHitter *entry, const char *word, size_t length, uint64_t hash) {
+    if (length + 1 > entry->word_capacity) {
+        char *temp = realloc(entry->word, length + 1);
+        if (!temp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        entry->word = temp;
+        entry->word_capacity = (uint32_t)(length + 1);
+    }
+    memcpy(entry->word, word, length);
+    entry->word[length] = '\0';
+    entry->length = (uint32_t)length;
+    entry->hash = hash;
+}
+
+/* Count count more occurrences of a word. A new word takes a free entry or
+ * replaces the weakest one, inheriting its count as the new word's error. */
+void space_saving_offer(SpaceSaving *list, const char *word, size_t length, uint64_t hash, uint64_t count) {
+    if (list->capacity == 0) {
+        return;
+    }
+    size_t slot = index_find(list, word, length, hash);
+    if (list->index[slot]) {
+        size_t found = list->index[slot] - 1;
+        list->entries[found].count += count;
+        heap_sift_down(list, list->heap_position[found]);
+        return;
+    }
+
+    if (list->size < list->capacity) {
+        size_t added = list->size++;
+        HeavyHitter *entry = &list->entries[added];
+        entry_set_word(entry, word, length, hash);
+        entry->count = count;
+        entry->error = 0;
+        list->index[slot] = added + 1;
+        list->heap[added] = added;
+        list->heap_position[added] = added;
+        heap_sift_up(list, added);
+        return;
+    }
+
+    size_t weakest = list->heap[0];
+    HeavyHitter *entry = &list->entries[weakest];
+    index_remove(list, weakest);
+    entry_set_word(entry, word, length, hash);
+    entry->error = entry->count;
+    entry->count += count;
+    list->index[index_find(list, word, length, hash)] = weakest + 1;
+    heap_sift_down(list, 0);
+}
+
+/* Most times a word missing from the list can have occurred */
+uint64_t space_saving_floor(const SpaceSaving *list) {
+    return list->size < list->capacity ? 0 : list->entries[list->heap[0]].count;
+}
+
+void space_saving_free(SpaceSaving *list) {
+    for (size_t i = 0; i < list->capacity; i++) {
+        free(list->entries[i].word);
+    }
+    free(list->entries);
+    free(list->heap);
+    free(list->heap_position);
+    free(list->index);
+    list->entries = NULL;
+    list->size = list->capacity = 0;
+}
+
+/* Initialize a builder's counter for a list of capacity heavy hitters */
+void approx_counter_init(ApproxCounter *counter, size_t capacity) {
+    sketch_init(&counter->sketch, SKETCH_DEPTH, sketch_width_for(capacity));
+    space_saving_init(&counter->heavy_hitters, capacity);
+    counter->total_count = 0;
+}
+
+/* Count count occurrences of a word */
+void approx_counter_add(ApproxCounter *counter, const char *word, size_t length, uint64_t count) {
+    uint64_t hash = word_hash(word, length);
+    sketch_add(&counter->sketch, hash, count);
+    space_saving_offer(&counter->heavy_hitters, word, length, hash, count);
+    counter->total_count += count;
+}
+
+void approx_counter_free(ApproxCounter *counter) {
+    sketch_free(&counter->sketch);
+    space_saving_free(&counter->heavy_hitters);
+}
+
+/* Initialize an empty merge of num_sources builders */
+void approx_merge_init(ApproxMerge *merge, int num_sources) {
+    merge->sketch.depth = merge->sketch.width = 0;
+    merge->sketch.counters = NULL;
+    merge->num_sources = num_sources;
+    merge->floors = calloc(num_sources, sizeof(uint64_t));
+    if (!merge->floors) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    merge->candidates = NULL;
+    merge->num_candidates = 0;
+    merge->candidates_capacity = 0;
+    arena_init(&merge->words, ARENA_BLOCK_SIZE);
+}
+
+/* Add one row of a builder's sketch; counters need not be aligned.
+ * Returns 0, or -1 if the row does not fit the sketches seen so far. */
+int approx_merge_sketch_row(ApproxMerge *merge, int source, uint32_t depth, uint32_t width, uint32_t row,
+                            uint64_t floor, const void *counters) {
+    if (!merge->sketch.counters) {
+        if (depth == 0 || width == 0 || (width & (width - 1)) != 0) {
+            return -1;
+        }
+        sketch_init(&merge->sketch, depth, width);
+    }
+    if (depth != merge->sketch.depth || width != merge->sketch.width || row >= depth ||
+        source < 0 || source >= merge->num_sources) {
+        return -1;
+    }
+    merge->floors[source] = floor;
+    uint64_t *target = &merge->sketch.counters[(size_t)row * width];
+    const char *bytes = counters;
+    for (uint32_t i = 0; i < width; i++) {
+        uint64_t value;
+        memcpy(&value, bytes + (size_t)i * sizeof(value), sizeof(value));
+        target[i] += value;
+    }
+    return 0;
+}
+
+/* Record one entry of a builder's list */
+void approx_merge_candidate(ApproxMerge *merge, int source, const char *word, size_t length, uint64_t count,
+                            uint64_t error) {
+    if (merge->num_candidates >= merge->candidates_capacity) {
+        size_t new_capacity = merge->candidates_capacity ? merge->candidates_capacity * 2 : INITIAL_HASH_SIZE;
+        ApproxCandidate *temp = realloc(merge->candidates, new_capacity * sizeof(ApproxCandidate));
+        if (!temp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        merge->candidates = temp;
+        merge->candidates_capacity = new_capacity;
+    }
+    ApproxCandidate *candidate = &merge->candidates[merge->num_candidates++];
+    candidate->word = arena_strndup(&merge->words, word, length);
+    candidate->length = (uint32_t)length;
+    candidate->source = source;
+    candidate->count = count;
+    candidate->error = error;
+}
+
+/* Add a builder's whole counter, as the threaded engine hands it over */
+int approx_merge_counter(ApproxMerge *merge, int source, const ApproxCounter *counter) {
+    const CountMinSketch *sketch = &counter->sketch;
+    const SpaceSaving *list = &counter->heavy_hitters;
+    uint64_t floor = space_saving_floor(list);
+    for (uint32_t row = 0; row < sketch->depth; row++) {
+        if (approx_merge_sketch_row(merge, source, sketch->depth, sketch->width, row, floor,
+                                    &sketch->counters[(size_t)row * sketch->width]) == -1) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < list->size; i++) {
+        const HeavyHitter *entry = &list->entries[i];
+        approx_merge_candidate(merge, source, entry->word, entry->length, entry->count, entry->error);
+    }
+    return 0;
+}
+
+static int compare_candidate_words(const void *a, const void *b) {
+    const ApproxCandidate *x = a, *y = b;
+    return strcmp(x->word, y->word);
+}
+
+/* Output order: higher upper bound first, then smaller word first */
+static int compare_approx_words(const void *a, const void *b) {
+    const ApproxWord *x = a, *y = b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return strcmp(x->word, y->word);
+}
+
+/* Bound every candidate word and select the top_k by upper bound. *result
+ * is allocated for the caller and its words live as long as the merge.
+ * Returns the number of words selected. */
+size_t approx_merge_finish(ApproxMerge *merge, size_t top_k, ApproxWord **result) {
+    uint64_t floor_sum = 0;
+    for (int i = 0; i < merge->num_sources; i++) {
+        floor_sum += merge->floors[i];
+    }
+
+    qsort(merge->candidates, merge->num_candidates, sizeof(ApproxCandidate), compare_candidate_words);
+    ApproxWord *words = malloc((merge->num_candidates ? merge->num_candidates : 1) * sizeof(ApproxWord));
+    if (!words) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t num_words = 0;
+    for (size_t i = 0; i < merge->num_candidates;) {
+        const ApproxCandidate *first = &merge->candidates[i];
+        uint64_t listed = 0, lower = 0, listed_floors = 0;
+        for (; i < merge->num_candidates && strcmp(merge->candidates[i].word, first->word) == 0; i++) {
+            const ApproxCandidate *candidate = &merge->candidates[i];
+            listed += candidate->count;
+            lower += candidate->count - candidate->error;
+            listed_floors += merge->floors[candidate->source];
+        }
+        // Builders whose lists lack the word saw it at most floor times each
+        uint64_t upper = listed + (floor_sum - listed_floors);
+        if (merge->sketch.counters) {
+            uint64_t estimate = sketch_estimate(&merge->sketch, word_hash(first->word, first->length));
+            if (estimate < upper) {
+                upper = estimate;
+            }
+        }
+        words[num_words].word = first->word;
+        words[num_words].count = upper;
+        words[num_words].lower = lower;
+        num_words++;
+    }
+
+    qsort(words, num_words, sizeof(ApproxWord), compare_approx_words);
+    *result = words;
+    return num_words < top_k ? num_words : top_k;
+}
+
+void approx_merge_free(ApproxMerge *merge) {
+    sketch_free(&merge->sketch);
+    free(merge->floors);
+    free(merge->candidates);
+    arena_free(&merge->words);
+}
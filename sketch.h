@@ -0,0 +1,121 @@
+/* sketch.h */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+/*
+ * Bounded-memory approximate counting behind lexan --approx N.
+ *
+ * Every builder keeps a Count-Min Sketch of all the words it sees and a
+ * Space-Saving list of its N heaviest words, so its memory does not grow
+ * with the vocabulary. A sketch never underestimates a word. A list entry
+ * overestimates its word by at most the entry's error, and a word missing
+ * from a full list occurred at most floor times, the count of the list's
+ * weakest entry.
+ *
+ * The root adds the builders' sketches row by row and gathers their lists.
+ * For every word on some list it then knows an upper bound (the smaller of
+ * the sketch estimate and the lists' sums) and a lower bound (the sum of
+ * count - error over the lists that hold it); both hold for every input,
+ * the sketch estimate itself is within e / width of the total count with
+ * probability 1 - exp(-depth).
+ */
+
+#define SKETCH_DEPTH 4
+#define SKETCH_MIN_WIDTH 1024
+#define SKETCH_WIDTH_PER_ENTRY 8            /* sketch columns per heavy hitter */
+
+typedef struct CountMinSketch {
+    uint32_t depth;
+    uint32_t width;                         /* a power of two */
+    uint64_t *counters;                     /* depth rows of width counters */
+} CountMinSketch;
+
+typedef struct HeavyHitter {
+    char *word;                             /* owned, reused when the entry is replaced */
+    uint32_t length;
+    uint32_t word_capacity;
+    uint64_t hash;
+    uint64_t count;                         /* upper bound of the word's count */
+    uint64_t error;                         /* count - error is a lower bound */
+} HeavyHitter;
+
+/* Space-Saving list: a min-heap on count to find the entry to replace and
+ * an open-addressing index on the word hash to find a word's entry */
+typedef struct SpaceSaving {
+    HeavyHitter *entries;
+    size_t size;
+    size_t capacity;
+    size_t *heap;                           /* entry indices, weakest first */
+    size_t *heap_position;                  /* where each entry sits in heap */
+    size_t *index;                          /* entry index + 1, 0 for an empty slot */
+    size_t index_mask;
+} SpaceSaving;
+
+/* What one builder keeps in place of its hash table */
+typedef struct ApproxCounter {
+    CountMinSketch sketch;
+    SpaceSaving heavy_hitters;
+    uint64_t total_count;
+} ApproxCounter;
+
+/* A word of the merged result with its bounds */
+typedef struct ApproxWord {
+    const char *word;
+    uint64_t count;                         /* upper bound, used for ranking */
+    uint64_t lower;                         /* lower bound */
+} ApproxWord;
+
+/* One list entry received from a builder */
+typedef struct ApproxCandidate {
+    const char *word;
+    uint32_t length;
+    int source;
+    uint64_t count;
+    uint64_t error;
+} ApproxCandidate;
+
+/* The root's merge of every builder's sketch and list */
+typedef struct ApproxMerge {
+    CountMinSketch sketch;                  /* sum of the builders' sketches */
+    int num_sources;
+    uint64_t *floors;                       /* floor of every builder's list */
+    ApproxCandidate *candidates;
+    size_t num_candidates;
+    size_t candidates_capacity;
+    Arena words;
+} ApproxMerge;
+
+/* Count-Min Sketch Functions */
+void sketch_init(CountMinSketch *sketch, uint32_t depth, uint32_t width);
+void sketch_add(CountMinSketch *sketch, uint64_t hash, uint64_t count);
+uint64_t sketch_estimate(const CountMinSketch *sketch, uint64_t hash);
+void sketch_free(CountMinSketch *sketch);
+uint32_t sketch_width_for(size_t capacity);
+
+/* Space-Saving Functions */
+void space_saving_init(SpaceSaving *list, size_t capacity);
+void space_saving_offer(SpaceSaving *list, const char *word, size_t length, uint64_t hash, uint64_t count);
+uint64_t space_saving_floor(const SpaceSaving *list);
+void space_saving_free(SpaceSaving *list);
+
+/* Approximate Counter Functions */
+void approx_counter_init(ApproxCounter *counter, size_t capacity);
+void approx_counter_add(ApproxCounter *counter, const char *word, size_t length, uint64_t count);
+void approx_counter_free(ApproxCounter *counter);
+
+/* Merge Functions */
+void approx_merge_init(ApproxMerge *merge, int num_sources);
+int approx_merge_sketch_row(ApproxMerge *merge, int source, uint32_t depth, uint32_t width, uint32_t row,
+                            uint64_t floor, const void *counters);
+void approx_merge_candidate(ApproxMerge *merge, int source, const char *word, size_t length, uint64_t count,
+                            uint64_t error);
+int approx_merge_counter(ApproxMerge *merge, int source, const ApproxCounter *counter);
+size_t approx_merge_finish(ApproxMerge *merge, size_t top_k, ApproxWord **result);
+void approx_merge_free(ApproxMerge *merge);
+
+#endif
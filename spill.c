@@ -0,0 +1,354 @@
+/* spill.c */
+
+#define _GNU_SOURCE
+#include "spill.h"
+#include "wire.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* One input of the merge: a run file, or the sorted slots of the last table */
+typedef struct MergeSource {
+    WireReader reader;
+    int is_table;
+    const HashSlot **slots;
+    size_t next_slot;
+    size_t num_slots;
+    const char *word;           /* current word, valid until the source advances */
+    uint32_t length;
+    uint64_t count;
+} MergeSource;
+
+void spill_init(SpillSet *set) {
+    set->fds = NULL;
+    set->levels = NULL;
+    set->count = 0;
+    set->capacity = 0;
+    set->bytes_written = 0;
+}
+
+static int compare_slot_words(const void *a, const void *b) {
+    const HashSlot *x = *(const HashSlot *const *)a;
+    const HashSlot *y = *(const HashSlot *const *)b;
+    return strcmp(x->key, y->key);
+}
+
+/* The table's used slots in word order; the caller frees the array */
+static const HashSlot **sorted_slots(const HashTable *table) {
+    const HashSlot **slots = malloc((table->count ? table->count : 1) * sizeof(HashSlot *));
+    if (!slots) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        if (table->ctrl[i] != HASH_SLOT_EMPTY) {
+            slots[used++] = &table->slots[i];
+        }
+    }
+    qsort(slots, used, sizeof(HashSlot *), compare_slot_words);
+    return slots;
+}
+
+/* Open an unlinked temporary file for a run */
+static int open_run_file(void) {
+    const char *directory = getenv("TMPDIR");
+    if (!directory || directory[0] == '\0') {
+        directory = "/tmp";
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, SPILL_TEMPLATE);
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        return -1;
+    }
+    unlink(path);
+    return fd;
+}
+
+/* Make room for one more run */
+static void reserve_run(SpillSet *set) {
+    if (set->count < set->capacity) {
+        return;
+    }
+    size_t new_capacity = set->capacity ? set->capacity * 2 : 8;
+    int *fds = realloc(set->fds, new_capacity * sizeof(int));
+    if (!fds) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    set->fds = fds;
+    int *levels = realloc(set->levels, new_capacity * sizeof(int));
+    if (!levels) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    set->levels = levels;
+    set->capacity = new_capacity;
+}
+
+static int compact_runs(SpillSet *set, size_t first);
+
+/* Write the table as a sorted run and replace it with an empty table.
+ * Returns 0, or -1 if the run could not be written. */
+int spill_table(SpillSet *set, HashTable **table) {
+    reserve_run(set);
+    int fd = open_run_file();
+    if (fd == -1) {
+        return -1;
+    }
+
+    const HashSlot **slots = sorted_slots(*table);
+    WireWriter writer;
+    wire_writer_init(&writer, fd, WIRE_BUFFER_SIZE);
+    int status = 0;
+    for (size_t i = 0; i < (*table)->count && status == 0; i++) {
+        status = wire_write_count(&writer, slots[i]->key, slots[i]->length, slots[i]->count);
+    }
+    if (status == 0) {
+        status = wire_flush(&writer);
+    }
+    set->bytes_written += writer.bytes_written;
+    wire_writer_free(&writer);
+    free(slots);
+    if (status == -1) {
+        close(fd);
+        return -1;
+    }
+    set->fds[set->count] = fd;
+    set->levels[set->count] = 0;
+    set->count++;
+
+    // A new table rather than a cleared one, so the slot array shrinks back too
+    free_hash_table(*table);
+    *table = create_hash_table();
+    if (!*table) {
+        fprintf(stderr, "Failed to create hash table.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Levels never increase along the array, so runs of equal level are its tail
+    while (set->count >= SPILL_FAN_IN &&
+           set->levels[set->count - SPILL_FAN_IN] == set->levels[set->count - 1]) {
+        if (compact_runs(set, set->count - SPILL_FAN_IN) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Move a source to its next word. Returns 1, 0 when it is exhausted, -1 on error. */
+static int advance_source(MergeSource *source) {
+    if (source->is_table) {
+        if (source->next_slot >= source->num_slots) {
+            return 0;
+        }
+        const HashSlot *slot = source->slots[source->next_slot++];
+        source->word = slot->key;
+        source->length = slot->length;
+        source->count = slot->count;
+        return 1;
+    }
+    for (;;) {
+        WireRecord record;
+        int status = wire_next_record(&source->reader, &record);
+        if (status == 1 && !record.is_trailer && !record.is_sketch_row) {
+            source->word = record.word;
+            source->length = record.length;
+            source->count = record.count;
+            return 1;
+        }
+        if (status != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        ssize_t n = wire_reader_fill(&source->reader);
+        if (n == -1) {
+            return -1;
+        }
+        if (n == 0) {
+            if (wire_reader_pending(&source->reader) > 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            return 0;
+        }
+    }
+}
+
+/* Min-heap of source indices on their current word */
+static void sift_down(MergeSource *sources, size_t *heap, size_t size, size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < size && strcmp(sources[heap[left]].word, sources[heap[smallest]].word) < 0) {
+            smallest = left;
+        }
+        if (right < size && strcmp(sources[heap[right]].word, sources[heap[smallest]].word) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        size_t temp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = temp;
+        i = smallest;
+    }
+}
+
+/* Merge the runs from first on, and the table unless it is NULL, calling emit
+ * once per distinct word in ascending order. Returns 0, or -1 if a run could
+ * not be read or emit failed. */
+static int merge_runs(SpillSet *set, size_t first, const HashTable *table, spill_emit emit, void *context) {
+    size_t num_runs = set->count - first;
+    size_t num_sources = num_runs + (table ? 1 : 0);
+    MergeSource *sources = calloc(num_sources ? num_sources : 1, sizeof(MergeSource));
+    size_t *heap = malloc((num_sources ? num_sources : 1) * sizeof(size_t));
+    if (!sources || !heap) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < num_runs; i++) {
+        if (lseek(set->fds[first + i], 0, SEEK_SET) == -1) {
+            for (size_t j = 0; j < i; j++) {
+                wire_reader_free(&sources[j].reader);
+            }
+            free(sources);
+            free(heap);
+            return -1;
+        }
+        wire_reader_init(&sources[i].reader, set->fds[first + i], WIRE_BUFFER_SIZE);
+    }
+    if (table) {
+        MergeSource *table_source = &sources[num_runs];
+        table_source->is_table = 1;
+        table_source->slots = sorted_slots(table);
+        table_source->num_slots = table->count;
+    }
+
+    int status = 0;
+    size_t heap_size = 0;
+    for (size_t i = 0; i < num_sources; i++) {
+        int more = advance_source(&sources[i]);
+        if (more == -1) {
+            status = -1;
+        } else if (more) {
+            heap[heap_size++] = i;
+        }
+    }
+    for (size_t i = heap_size; i-- > 0;) {
+        sift_down(sources, heap, heap_size, i);
+    }
+
+    // The smallest word is copied before its source advances, and its count
+    // grows while the following sources hold the same word
+    char *word = NULL;
+    size_t word_capacity = 0;
+    uint32_t length = 0;
+    uint64_t count = 0;
+    int pending = 0;
+    while (status == 0 && heap_size > 0) {
+        MergeSource *source = &sources[heap[0]];
+        if (pending && source->length == length && memcmp(source->word, word, length) == 0) {
+            count += source->count;
+        } else {
+            if (pending && emit(word, length, count, context) == -1) {
+                status = -1;
+                break;
+            }
+            if (source->length + 1 > word_capacity) {
+                word_capacity = source->length + 1;
+                char *temp = realloc(word, word_capacity);
+                if (!temp) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+                word = temp;
+            }
+            memcpy(word, source->word, source->length + 1);
+            length = source->length;
+            count = source->count;
+            pending = 1;
+        }
+
+        int more = advance_source(source);
+        if (more == -1) {
+            status = -1;
+        } else if (!more) {
+            heap[0] = heap[--heap_size];
+        }
+        sift_down(sources, heap, heap_size, 0);
+    }
+    if (status == 0 && pending && emit(word, length, count, context) == -1) {
+        status = -1;
+    }
+
+    free(word);
+    for (size_t i = 0; i < num_runs; i++) {
+        wire_reader_free(&sources[i].reader);
+    }
+    if (table) {
+        free(sources[num_runs].slots);
+    }
+    free(sources);
+    free(heap);
+    return status;
+}
+
+/* emit for an intermediate pass: append the word to the new run */
+static int write_run_word(const char *word, uint32_t length, uint64_t count, void *context) {
+    return wire_write_count(context, word, length, count);
+}
+
+/* Merge the runs from first on into a single run one level above the highest
+ * of them, closing the old ones. Returns 0, or -1 if a run failed. */
+static int compact_runs(SpillSet *set, size_t first) {
+    int fd = open_run_file();
+    if (fd == -1) {
+        return -1;
+    }
+    WireWriter writer;
+    wire_writer_init(&writer, fd, WIRE_BUFFER_SIZE);
+    int status = merge_runs(set, first, NULL, write_run_word, &writer);
+    if (status == 0) {
+        status = wire_flush(&writer);
+    }
+    set->bytes_written += writer.bytes_written;
+    wire_writer_free(&writer);
+    if (status == -1) {
+        close(fd);
+        return -1;
+    }
+    for (size_t i = first; i < set->count; i++) {
+        close(set->fds[i]);
+    }
+    set->fds[first] = fd;
+    set->levels[first]++;
+    set->count = first + 1;
+    return 0;
+}
+
+/* Merge every run with the table, calling emit once per distinct word in
+ * ascending order. Returns 0, or -1 if a run could not be read or emit failed. */
+int spill_merge(SpillSet *set, const HashTable *table, spill_emit emit, void *context) {
+    // Leave at most SPILL_FAN_IN runs, merging the smallest ones first
+    while (set->count > SPILL_FAN_IN) {
+        if (compact_runs(set, set->count - SPILL_FAN_IN) == -1) {
+            return -1;
+        }
+    }
+    return merge_runs(set, 0, table, emit, context);
+}
+
+/* Close, and so delete, every run */
+void spill_free(SpillSet *set) {
+    for (size_t i = 0; i < set->count; i++) {
+        close(set->fds[i]);
+    }
+    free(set->fds);
+    free(set->levels);
+    spill_init(set);
+}
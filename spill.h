@@ -0,0 +1,49 @@
+/* spill.h */
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_table.h"
+
+/*
+ * Sorted runs behind lexan --mem-limit BYTES.
+ *
+ * When a builder's table grows past its budget, the table's words are
+ * sorted and written to an unlinked temporary file as builder -> root count
+ * frames (wire.h), and the builder carries on with a fresh table. At the end
+ * of input the runs and the last table are merged in word order, adding up
+ * the counts of equal words, so every word comes out exactly once and in
+ * sorted order. Temporary files go to $TMPDIR, or /tmp.
+ *
+ * No merge reads more than SPILL_FAN_IN runs at once. Whenever SPILL_FAN_IN
+ * runs of the same level exist they are merged into one run of the next
+ * level, so open files and read buffers grow with the logarithm of the
+ * number of spills; before the final merge the remaining runs are merged
+ * down to SPILL_FAN_IN the same way.
+ */
+
+#define SPILL_MIN_LIMIT (4 * 1024 * 1024)       /* smaller budgets would spill all the time */
+#define SPILL_TEMPLATE "lexan-run-XXXXXX"
+#define SPILL_FAN_IN 16                         /* runs read by one merge pass */
+
+typedef struct SpillSet {
+    int *fds;                                   /* one unlinked file per run */
+    int *levels;                                /* merge passes behind each run, never increasing */
+    size_t count;
+    size_t capacity;
+    uint64_t bytes_written;                     /* by spills and intermediate merges */
+} SpillSet;
+
+/* Receives every merged word once, in ascending order; the word is only valid
+ * during the call. Returns 0, or -1 to stop the merge. */
+typedef int (*spill_emit)(const char *word, uint32_t length, uint64_t count, void *context);
+
+/* Spill Functions */
+void spill_init(SpillSet *set);
+int spill_table(SpillSet *set, HashTable **table);
+int spill_merge(SpillSet *set, const HashTable *table, spill_emit emit, void *context);
+void spill_free(SpillSet *set);
+
+#endif
@@ -3,8 +3,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
-#include <ctype.h>
+#include <errno.h>
 #include"splitter.h"
+#include "hash_table.h"
+#include "wire.h"
+#include "exclusion_set.h"
+#include "tokenizer.h"
+#include "input_range.h"
+#include "ring.h"
+#include "chunk_queue.h"
+#include "stats.h"
 
 
 
@@ -13,89 +21,135 @@
 
 
 
-// Συνάρτηση για δημιουργία νέου κόμβου exclusion word
-ExclusionWord* create_exclusion_word(const char *word) {
-    ExclusionWord *node = malloc(sizeof(ExclusionWord));
-    if (!node) {
-        perror("malloc");
-        exit(1);
-    }
-    node->word = strdup(word);
-    if (!node->word) {
-        perror("strdup");
-        exit(1);
+// Κατάσταση που χρειάζεται ο tokenizer για κάθε λέξη που βρίσκει
+typedef struct SplitterContext {
+    const ExclusionSet *exclusion_set;
+    WireWriter *writers;
+    int num_builders;
+    RoutingMode routing;
+    uint64_t total_words_sent; // πλαίσια που στάλθηκαν (καθορίζει και το round-robin)
+    uint64_t tokens_seen;
+    uint64_t tokens_excluded;
+    uint64_t tokens_sent;   // λέξεις εκτός λίστας εξαιρέσεων, είτε στάλθηκαν μόνες είτε συναθροισμένες
+    int error;              // 0, ή το errno της αποτυχημένης εγγραφής
+    HashTable *combiner;    // τοπική προ-συνάθροιση (--combine), ή NULL
+    size_t combine_limit;
+} SplitterContext;
+
+// Επιλογή builder για μια λέξη με γνωστό hash
+static int route_word(SplitterContext *ctx, uint64_t hash) {
+    if (ctx->routing == ROUTE_HASH) {
+        return partition_for_hash(hash, ctx->num_builders);
     }
-    node->left = node->right = NULL;
-    return node;
+    return (int)(ctx->total_words_sent % (uint64_t)ctx->num_builders);
 }
 
-// Συνάρτηση για εισαγωγή λέξης στο exclusion tree
-void insert_exclusion_word(ExclusionTree *tree, const char *word) {
-    ExclusionWord **current = &(tree->root);
-    while (*current) {
-        int cmp = strcmp(word, (*current)->word);
-        if (cmp < 0) {
-            current = &((*current)->left);
-        } else if (cmp > 0) {
-            current = &((*current)->right);
-        } else {
-            // Η λέξη υπάρχει ήδη στο δέντρο
+// Αποστολή όλων των (λέξη, πλήθος) του combiner στους builders και άδειασμα του πίνακα.
+// Χρησιμοποιείται το αποθηκευμένο hash κάθε θέσης, οπότε οι λέξεις δεν ξανακατακερματίζονται.
+static void flush_combiner(SplitterContext *ctx) {
+    HashTable *table = ctx->combiner;
+    for (size_t i = 0; i < table->size && !ctx->error; i++) {
+        if (table->ctrl[i] == HASH_SLOT_EMPTY) {
+            continue;
+        }
+        const HashSlot *slot = &table->slots[i];
+        int builder_index = route_word(ctx, slot->hash);
+        if (wire_write_counted_word(&ctx->writers[builder_index], slot->key, slot->length, slot->count) == -1) {
+            ctx->error = errno;
             return;
         }
+        ctx->total_words_sent++;
     }
-    *current = create_exclusion_word(word);
+    hash_table_clear(table);
 }
 
-// Συνάρτηση για έλεγχο αν μια λέξη είναι εξαιρούμενη
-int is_excluded(ExclusionTree *tree, const char *word) {
-    ExclusionWord *current = tree->root;
-    while (current) {
-        int cmp = strcmp(word, current->word);
-        if (cmp < 0) {
-            current = current->left;
-        } else if (cmp > 0) {
-            current = current->right;
-        } else {
-            return 1;
+// Αποστολή μιας (ήδη καθαρισμένης) λέξης στον builder που της αντιστοιχεί
+static void send_word(const char *word, size_t word_length, void *context) {
+    SplitterContext *ctx = context;
+    if (ctx->error) {
+        return;
+    }
+    ctx->tokens_seen++;
+    if (exclusion_set_contains(ctx->exclusion_set, word, word_length)) {
+        ctx->tokens_excluded++;
+        return;
+    }
+    ctx->tokens_sent++;
+
+    // Με combiner οι λέξεις μετριούνται τοπικά και στέλνονται όταν γεμίσει ο πίνακας
+    if (ctx->combiner) {
+        insert_or_update_word_n(ctx->combiner, word, word_length, 1);
+        if (ctx->combiner->count >= ctx->combine_limit) {
+            flush_combiner(ctx);
         }
+        return;
     }
-    return 0;
-}
 
-// Συνάρτηση για ελευθέρωση του exclusion tree
-void free_exclusion_tree(ExclusionWord *node) {
-    if (node) {
-        free_exclusion_tree(node->left);
-        free_exclusion_tree(node->right);
-        free(node->word);
-        free(node);
+    int builder_index = route_word(ctx, ctx->routing == ROUTE_HASH ? word_hash(word, word_length) : 0);
+
+    if (wire_write_word(&ctx->writers[builder_index], word, word_length) == -1) {
+        ctx->error = errno;
+        return;
     }
+    ctx->total_words_sent++;
 }
 
-
-// Συνάρτηση για αφαίρεση σημείων στίξης από μια λέξη
-void strip_punctuation(char *word) {
-    char *src = word, *dst = word;
-    while (*src) {
-        // Copy only non-punctuation characters and skip double quotes
-        if (!ispunct((unsigned char)*src)) {
-            *dst++ = *src;
-        }
-        src++;
+// Απελευθέρωση των buffers εξόδου προς τους builders
+void free_writers(WireWriter *writers, int count) {
+    for (int i = 0; i < count; i++) {
+        wire_writer_free(&writers[i]);
     }
-    *dst = '\0';
+    free(writers);
 }
+
 int main(int argc, char *argv[]) {
-    if (argc < 6) {
-        fprintf(stderr, "Usage: %s <splitter_id> <input_file> <exclusion_file> <num_builders> <pipe_fds>\n", argv[0]);
+    if (argc < 9) {
+        fprintf(stderr, "Usage: %s <splitter_id> <exclusion_file> <num_builders> <pipe_fds> <chunk_queue> <routing> <combine_limit> <stats_spec> [<ring_spec> <wait_fd>]\n", argv[0]);
         return 1;
     }
 
+    double start_time = stats_now();
+
     // Μετατροπή των παραμέτρων
-    int num_builders = atoi(argv[4]);
-    char *input_file = argv[2];
-    char *exclusion_file = argv[3];
-    char *pipe_fds_str = argv[5];
+    int splitter_id = atoi(argv[1]);
+    int num_builders = atoi(argv[3]);
+    char *exclusion_file = argv[2];
+    char *pipe_fds_str = argv[4];
+
+    // Η ουρά κομματιών του lexan (chunk_queue.h): ο splitter παίρνει το επόμενο ελεύθερο
+    // κομμάτι, από οποιοδήποτε αρχείο εισόδου, μέχρι να εξαντληθούν. Ο lexan έχει ήδη
+    // ευθυγραμμίσει τα όρια ώστε καμία λέξη να μη μοιράζεται σε δύο κομμάτια.
+    ChunkQueue chunks;
+    if (chunk_queue_map(&chunks, argv[5]) == -1) {
+        perror("map chunk queue");
+        return 1;
+    }
+
+    // Τρόπος δρομολόγησης λέξεων στους builders
+    RoutingMode routing;
+    if (strcmp(argv[6], ROUTING_HASH_NAME) == 0) {
+        routing = ROUTE_HASH;
+    } else if (strcmp(argv[6], ROUTING_ROUND_ROBIN_NAME) == 0) {
+        routing = ROUTE_ROUND_ROBIN;
+    } else {
+        fprintf(stderr, "Unknown routing mode: %s\n", argv[6]);
+        return 1;
+    }
+
+    // Όριο διαφορετικών λέξεων του τοπικού combiner (0: κάθε λέξη στέλνεται αμέσως)
+    long combine_limit = strtol(argv[7], NULL, 10);
+    if (combine_limit < 0) {
+        fprintf(stderr, "Invalid combine limit: %s\n", argv[7]);
+        return 1;
+    }
+
+    // Οι μετρητές του splitter γράφονται στο τέλος στη θέση του στο memfd των
+    // στατιστικών (stats.h), απ' όπου τους διαβάζει ο lexan για το --stats
+    StatsRegion stats;
+    if (stats_region_map(&stats, argv[8]) == -1 || splitter_id < 0 || splitter_id >= stats.num_splitters) {
+        fprintf(stderr, "Invalid stats region: %s\n", argv[8]);
+        return 1;
+    }
 
     // Δυναμική διάθεση μνήμης για τους file descriptors
     int fd_capacity = INITIAL_PIPE_CAPACITY;
@@ -124,96 +178,173 @@ int main(int argc, char *argv[]) {
         token = strtok(NULL, " ");
     }
 
-    // Δημιουργία του exclusion tree
-    ExclusionTree exclusion_tree = { .root = NULL };
+    // Μεταφορά μέσω κοινόχρηστης μνήμης (ring.h): κάθε ακμή splitter->builder είναι ένας
+    // δακτύλιος στο memfd του lexan. Τότε τα pipe_fds είναι τα eventfd των builders και ο
+    // splitter περιμένει στο δικό του eventfd μόνο όταν κάποιος δακτύλιος γεμίσει.
+    RingRegion ring_region;
+    Ring *rings = NULL;
+    if (argc >= 11) {
+        if (ring_region_map(&ring_region, argv[9]) == -1) {
+            perror("map splitter rings");
+            free(pipe_fds);
+            return 1;
+        }
+        if (splitter_id < 0 || splitter_id >= ring_region.num_splitters || fd_count > ring_region.num_builders) {
+            fprintf(stderr, "Invalid ring layout: %s\n", argv[9]);
+            free(pipe_fds);
+            return 1;
+        }
+        rings = malloc(fd_count * sizeof(Ring));
+        if (!rings) {
+            perror("malloc");
+            free(pipe_fds);
+            return 1;
+        }
+        int wait_fd = atoi(argv[10]);
+        for (int i = 0; i < fd_count; i++) {
+            ring_attach(&rings[i], &ring_region, splitter_id, i, wait_fd, pipe_fds[i]);
+        }
+    }
 
-    FILE *excl_fp = fopen(exclusion_file, "r");
-    if (!excl_fp) {
-        perror("fopen exclusion_file");
+    // Φόρτωση του συνόλου εξαιρούμενων λέξεων: ένας επίπεδος πίνακας κατακερματισμού
+    // που ελέγχεται για κάθε λέξη της εισόδου. Αν το αρχείο είναι ήδη μεταγλωττισμένο
+    // (exclcompile ή lexan), γίνεται απλώς mmap και μοιράζεται με τους άλλους splitters.
+    ExclusionSet exclusion_set;
+    if (exclusion_set_load(&exclusion_set, exclusion_file) == -1) {
         free(pipe_fds);
         return 1;
     }
 
-    char excl_word[MAX_WORD_LENGTH];
-    while (fscanf(excl_fp, "%s", excl_word) != EOF) {
-        insert_exclusion_word(&exclusion_tree, excl_word);
+    // Ένας buffer ανά builder: οι λέξεις στέλνονται σε πλαίσια (wire.h) και
+    // γίνεται ένα write ανά γεμάτο buffer αντί για ένα write ανά λέξη
+    WireWriter *writers = malloc(fd_count * sizeof(WireWriter));
+    if (!writers) {
+        perror("malloc");
+        exclusion_set_free(&exclusion_set);
+        free(pipe_fds);
+        return 1;
+    }
+    for (int i = 0; i < fd_count; i++) {
+        if (rings) {
+            wire_writer_init_ring(&writers[i], &rings[i], WIRE_BUFFER_SIZE);
+        } else {
+            wire_writer_init(&writers[i], pipe_fds[i], WIRE_BUFFER_SIZE);
+        }
     }
-    fclose(excl_fp);
 
-    FILE *in_fp = fopen(input_file, "r");
-    if (!in_fp) {
-        perror("fopen input_file");
-        free_exclusion_tree(exclusion_tree.root);
+    if (fd_count < num_builders) {
+        fprintf(stderr, "Error: Not enough pipe file descriptors provided.\n");
+        free_writers(writers, fd_count);
+        exclusion_set_free(&exclusion_set);
         free(pipe_fds);
-        return 1;;
+        return 1;
     }
 
-    int total_words_sent = 0;
-    char *line = NULL;
-     ssize_t read;
-      size_t len = 0;
-    while ((read = getline(&line, &len, in_fp)) != -1) {
-        char *word = strtok(line, " \t\n");
-        while (word != NULL) {
-
-
- 
-            // Remove punctuation
-            strip_punctuation(word);
-
-            // Convert to lowercase
-            for (char *p = word; *p; ++p) {
-                *p = tolower((unsigned char)*p);
-            }
-
-            // Skip empty or excluded words
-            if (strlen(word) == 0 || is_excluded(&exclusion_tree, word)) {
-                word = strtok(NULL, " \t\n");
-                continue;
-            }
+    // Ο tokenizer κάνει σε ένα πέρασμα ό,τι έκαναν strtok, strip_punctuation και tolower
+    SplitterContext ctx = { &exclusion_set, writers, num_builders, routing, 0, 0, 0, 0, 0, NULL, (size_t)combine_limit };
+    if (combine_limit > 0) {
+        ctx.combiner = create_hash_table();
+    }
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer);
 
-            int builder_index = total_words_sent % num_builders;
-            if (builder_index >= fd_count) {
-                fprintf(stderr, "Error: Not enough pipe file descriptors provided.\n");
-                free(line);
+    // Κάθε κομμάτι διαβάζεται απευθείας από mmap του αρχείου του (βλ. input_range.h).
+    // Το αρχείο ανοίγει ξανά μόνο όταν το επόμενο κομμάτι ανήκει σε άλλο αρχείο.
+    // Το tokenizer_finish μετά από κάθε κομμάτι εμποδίζει μια λέξη στο τέλος του αρχείου
+    // να κολλήσει με την πρώτη λέξη του επόμενου κομματιού.
+    int status = 0;
+    size_t file, open_file = SIZE_MAX;
+    off_t offset, length;
+    FILE *in_fp = NULL;
+    SplitterStats *my_stats = &stats.splitters[splitter_id];
+    while (status == 0 && !ctx.error && chunk_queue_next(&chunks, &file, &offset, &length)) {
+        if (file != open_file) {
+            if (in_fp) {
                 fclose(in_fp);
-                free_exclusion_tree(exclusion_tree.root);
-                free(pipe_fds);
-                return 1;
             }
-
-            int write_fd = pipe_fds[builder_index];
-            if (dprintf(write_fd, "%s\n", word) < 0) {
-                perror("write word to builder pipe");
-                free(line);
-                fclose(in_fp);
-                free_exclusion_tree(exclusion_tree.root);
-                free(pipe_fds);
-                return 1;
+            in_fp = fopen(chunk_queue_file(&chunks, file), "r");
+            if (!in_fp) {
+                perror("fopen input_file");
+                status = -1;
+                break;
             }
-
-            total_words_sent++;
-            word = strtok(NULL, " \t\n");
+            open_file = file;
         }
+        status = tokenize_file_range(in_fp, offset, length, &tokenizer, send_word, &ctx, &ctx.error);
+        tokenizer_finish(&tokenizer, send_word, &ctx);
+        my_stats->chunks++;
+        my_stats->bytes_read += (uint64_t)length;
+    }
+    chunk_queue_unmap(&chunks);
+    tokenizer_free(&tokenizer);
+    if (ctx.combiner) {
+        flush_combiner(&ctx);
+        my_stats->combiner_resizes = ctx.combiner->resizes;
+        free_hash_table(ctx.combiner);
+    }
+    if (in_fp) {
+        fclose(in_fp);
+    }
+
+    if (status == -1) {
+        free_writers(writers, fd_count);
+        exclusion_set_free(&exclusion_set);
+        free(pipe_fds);
+        return 1;
+    }
+
+    if (ctx.error) {
+        errno = ctx.error;
+        perror("write word to builder pipe");
+        free_writers(writers, fd_count);
+        exclusion_set_free(&exclusion_set);
+        free(pipe_fds);
+        return 1;
     }
-    free(line);
-    fclose(in_fp);
 
-    // Κλείσιμο των write ends των pipes μετά την αποστολή όλων των λέξεων
+    // Αποστολή ό,τι έχει μείνει στους buffers και κλείσιμο των write ends των pipes
     for (int i = 0; i < fd_count; i++) {
-        close(pipe_fds[i]);
+        if (wire_flush(&writers[i]) == -1) {
+            perror("write word to builder pipe");
+            free_writers(writers, fd_count);
+            exclusion_set_free(&exclusion_set);
+            free(pipe_fds);
+            return 1;
+        }
+        if (rings) {
+            ring_close(&rings[i]);
+        } else {
+            close(pipe_fds[i]);
+        }
+        my_stats->bytes_written += writers[i].bytes_written;
+        my_stats->blocked_time += writers[i].blocked_time;
     }
+    free_writers(writers, fd_count);
+    if (rings) {
+        free(rings);
+        ring_region_unmap(&ring_region);
+    }
+
+    // Καταγραφή των μετρητών πριν ενημερωθεί ο γονέας
+    my_stats->tokens_seen = ctx.tokens_seen;
+    my_stats->tokens_excluded = ctx.tokens_excluded;
+    my_stats->tokens_sent = ctx.tokens_sent;
+    my_stats->frames_sent = ctx.total_words_sent;
+    my_stats->elapsed_time = stats_now() - start_time;
+    stats_usage(&my_stats->usage, RUSAGE_SELF);
+    my_stats->reported = 1;
+    stats_region_unmap(&stats);
 
     // Αποστολή σήματος SIGUSR1 στον γονέα για να ενημερωθεί ότι ολοκληρώθηκε η αποστολή λέξεων
     if (kill(getppid(), SIGUSR1) == -1) {
         perror("kill SIGUSR1");
-        free_exclusion_tree(exclusion_tree.root);
+        exclusion_set_free(&exclusion_set);
         free(pipe_fds);
         return 1;
     }
 
-    // Απελευθέρωση του exclusion tree και της μνήμης των pipe file descriptors
-    free_exclusion_tree(exclusion_tree.root);
+    // Απελευθέρωση του συνόλου εξαιρούμενων λέξεων και της μνήμης των pipe file descriptors
+    exclusion_set_free(&exclusion_set);
     free(pipe_fds);
 
     return 0;
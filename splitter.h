@@ -1,26 +1,32 @@
-
+#ifndef SPLITTER_H
+#define SPLITTER_H
 
 #define INITIAL_PIPE_CAPACITY 10
 #define MAX_WORD_LENGTH 100
 
-
-typedef struct ExclusionWord {
-    char *word;
-    struct ExclusionWord *left;
-    struct ExclusionWord *right;
-} ExclusionWord;
-
-typedef struct ExclusionTree {
-    ExclusionWord *root;
-} ExclusionTree;
-
-
-ExclusionWord* create_exclusion_word(const char *word);
-void insert_exclusion_word(ExclusionTree *tree, const char *word);
-int is_excluded(ExclusionTree *tree, const char *word);
-void free_exclusion_tree(ExclusionWord *node);
-
-
-void strip_punctuation(char *word);
-
-
+/* Τρόποι δρομολόγησης των λέξεων από τους splitters στους builders:
+ * ROUTE_HASH: κάθε λέξη πηγαίνει πάντα στον ίδιο builder (με βάση το hash της),
+ *             οπότε οι builders έχουν ξένα μεταξύ τους σύνολα λέξεων.
+ * ROUTE_ROUND_ROBIN: οι λέξεις μοιράζονται κυκλικά, με ισοκατανομή φορτίου
+ *             αλλά κάθε λέξη μπορεί να εμφανιστεί σε όλους τους builders. */
+typedef enum RoutingMode {
+    ROUTE_HASH,
+    ROUTE_ROUND_ROBIN
+} RoutingMode;
+
+#define ROUTING_HASH_NAME "hash"
+#define ROUTING_ROUND_ROBIN_NAME "roundrobin"
+
+/* Μεταφορά των λέξεων από τους splitters στους builders:
+ * TRANSPORT_PIPE: ένα pipe ανά ακμή splitter->builder.
+ * TRANSPORT_RING: ένας δακτύλιος σε κοινόχρηστη μνήμη ανά ακμή (ring.h),
+ *             χωρίς αντιγραφή μέσω του πυρήνα. */
+typedef enum Transport {
+    TRANSPORT_PIPE,
+    TRANSPORT_RING
+} Transport;
+
+#define TRANSPORT_PIPE_NAME "pipe"
+#define TRANSPORT_RING_NAME "ring"
+
+#endif
@@ -0,0 +1,158 @@
+/* stats.c */
+
+#define _GNU_SOURCE
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static size_t stats_region_size(int num_splitters, int num_builders) {
+    return (size_t)num_splitters * sizeof(SplitterStats) + (size_t)num_builders * sizeof(BuilderStats);
+}
+
+static void stats_region_layout(StatsRegion *region) {
+    region->splitters = region->block;
+    region->builders = (BuilderStats *)((char *)region->block + (size_t)region->num_splitters * sizeof(SplitterStats));
+}
+
+/* Create and map a zeroed region with one slot per splitter and builder */
+int stats_region_create(StatsRegion *region, int num_splitters, int num_builders) {
+    region->num_splitters = num_splitters;
+    region->num_builders = num_builders;
+    region->size = stats_region_size(num_splitters, num_builders);
+
+    region->fd = memfd_create("lexan-stats", 0);
+    if (region->fd == -1) {
+        return -1;
+    }
+    if (ftruncate(region->fd, (off_t)region->size) == -1) {
+        close(region->fd);
+        return -1;
+    }
+    region->block = mmap(NULL, region->size, PROT_READ | PROT_WRITE, MAP_SHARED, region->fd, 0);
+    if (region->block == MAP_FAILED) {
+        close(region->fd);
+        return -1;
+    }
+    stats_region_layout(region);
+    return 0;
+}
+
+/* Map a region created by lexan from its spec string */
+int stats_region_map(StatsRegion *region, const char *spec) {
+    if (sscanf(spec, "%d:%d:%d", &region->fd, &region->num_splitters, &region->num_builders) != 3 ||
+        region->num_splitters < 0 || region->num_builders < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    region->size = stats_region_size(region->num_splitters, region->num_builders);
+    region->block = mmap(NULL, region->size, PROT_READ | PROT_WRITE, MAP_SHARED, region->fd, 0);
+    if (region->block == MAP_FAILED) {
+        return -1;
+    }
+    stats_region_layout(region);
+    return 0;
+}
+
+/* Describe the region for stats_region_map in a child process */
+void stats_region_spec(const StatsRegion *region, char *spec, size_t size) {
+    snprintf(spec, size, "%d:%d:%d", region->fd, region->num_splitters, region->num_builders);
+}
+
+/* Unmap the region and close its descriptor */
+void stats_region_unmap(StatsRegion *region) {
+    munmap(region->block, region->size);
+    close(region->fd);
+    region->block = NULL;
+    region->fd = -1;
+}
+
+/* CPU time and peak RSS of RUSAGE_SELF or RUSAGE_THREAD */
+void stats_usage(ResourceUsage *usage, int who) {
+    struct rusage ru;
+    if (getrusage(who, &ru) == -1) {
+        memset(usage, 0, sizeof(*usage));
+        return;
+    }
+    usage->user_time = (double)ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    usage->sys_time = (double)ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    usage->peak_rss_kb = ru.ru_maxrss;
+}
+
+/* Monotonic clock in seconds, for phase timings */
+double stats_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void write_usage(FILE *fp, const ResourceUsage *usage) {
+    fprintf(fp, "\"user_s\": %.6f, \"sys_s\": %.6f, \"peak_rss_kb\": %ld", usage->user_time, usage->sys_time,
+            usage->peak_rss_kb);
+}
+
+/* Write the root's and every worker's statistics to path as JSON */
+int stats_write_json(const StatsRegion *region, const RootStats *root, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("fopen stats file");
+        return -1;
+    }
+
+    fprintf(fp, "{\n  \"root\": {\"engine\": \"%s\", \"transport\": \"%s\", \"routing\": \"%s\", "
+                "\"splitters\": %d, \"builders\": %d, \"input_files\": %llu, \"input_bytes\": %llu, \"chunks\": %llu, "
+                "\"total_tokens\": %llu, \"distinct_words\": %llu, \"split_s\": %.6f, \"merge_s\": %.6f, "
+                "\"sort_s\": %.6f, \"write_s\": %.6f, \"total_s\": %.6f, ",
+            root->engine, root->transport, root->routing, region->num_splitters, region->num_builders,
+            (unsigned long long)root->input_files, (unsigned long long)root->input_bytes,
+            (unsigned long long)root->chunks,
+            (unsigned long long)root->total_tokens, (unsigned long long)root->distinct_words, root->split_time,
+            root->merge_time, root->sort_time, root->write_time, root->total_time);
+    write_usage(fp, &root->usage);
+    fprintf(fp, "},\n  \"splitters\": [");
+
+    for (int i = 0; i < region->num_splitters; i++) {
+        const SplitterStats *s = &region->splitters[i];
+        fprintf(fp, "%s\n    {\"id\": %d, \"reported\": %s, \"chunks\": %llu, \"bytes_read\": %llu, "
+                    "\"tokens_seen\": %llu, \"tokens_excluded\": %llu, \"tokens_sent\": %llu, "
+                    "\"frames_sent\": %llu, \"bytes_written\": %llu, \"combiner_resizes\": %llu, "
+                    "\"blocked_s\": %.6f, \"elapsed_s\": %.6f, ",
+                i ? "," : "", i, s->reported ? "true" : "false", (unsigned long long)s->chunks,
+                (unsigned long long)s->bytes_read, (unsigned long long)s->tokens_seen,
+                (unsigned long long)s->tokens_excluded, (unsigned long long)s->tokens_sent,
+                (unsigned long long)s->frames_sent, (unsigned long long)s->bytes_written,
+                (unsigned long long)s->combiner_resizes, s->blocked_time, s->elapsed_time);
+        write_usage(fp, &s->usage);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n  \"builders\": [");
+
+    for (int i = 0; i < region->num_builders; i++) {
+        const BuilderStats *b = &region->builders[i];
+        fprintf(fp, "%s\n    {\"id\": %d, \"reported\": %s, \"bytes_read\": %llu, \"frames_received\": %llu, "
+                    "\"tokens_received\": %llu, \"bytes_written\": %llu, \"distinct_words\": %llu, "
+                    "\"table_resizes\": %llu, \"table_size\": %llu, \"mean_probe_length\": %.4f, "
+                    "\"max_probe_length\": %llu, \"spilled_runs\": %llu, \"spilled_bytes\": %llu, "
+                    "\"blocked_s\": %.6f, \"elapsed_s\": %.6f, ",
+                i ? "," : "", i, b->reported ? "true" : "false", (unsigned long long)b->bytes_read,
+                (unsigned long long)b->frames_received, (unsigned long long)b->tokens_received,
+                (unsigned long long)b->bytes_written, (unsigned long long)b->distinct_words,
+                (unsigned long long)b->table_resizes, (unsigned long long)b->table_size, b->mean_probe_length,
+                (unsigned long long)b->max_probe_length, (unsigned long long)b->spilled_runs,
+                (unsigned long long)b->spilled_bytes, b->blocked_time, b->elapsed_time);
+        write_usage(fp, &b->usage);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    if (fclose(fp) == EOF) {
+        perror("fclose stats file");
+        return -1;
+    }
+    return 0;
+}
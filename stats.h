@@ -0,0 +1,99 @@
+/* stats.h */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+/*
+ * Run statistics behind lexan --stats=FILE.
+ *
+ * lexan creates a small memfd with one fixed-size slot per splitter and per
+ * builder. Every worker, process or thread, fills its own slot just before
+ * it exits; the root reads the slots after the workers are gone, adds its
+ * own phase timings and writes everything out as one JSON document. A slot
+ * whose worker died before reporting keeps reported == 0.
+ */
+
+#define STATS_SPEC_SIZE 48
+
+/* CPU time and memory of one worker, from getrusage */
+typedef struct ResourceUsage {
+    double user_time;
+    double sys_time;
+    long peak_rss_kb;           /* whole process, also for threads */
+} ResourceUsage;
+
+typedef struct SplitterStats {
+    int reported;
+    uint64_t chunks;            /* input chunks claimed from the queue */
+    uint64_t bytes_read;
+    uint64_t tokens_seen;
+    uint64_t tokens_excluded;
+    uint64_t tokens_sent;       /* non-excluded tokens, whether sent alone or combined */
+    uint64_t frames_sent;
+    uint64_t bytes_written;
+    uint64_t combiner_resizes;  /* resizes of the --combine table */
+    double blocked_time;        /* seconds spent waiting to hand words to builders */
+    double elapsed_time;
+    ResourceUsage usage;
+} SplitterStats;
+
+typedef struct BuilderStats {
+    int reported;
+    uint64_t bytes_read;
+    uint64_t frames_received;
+    uint64_t tokens_received;
+    uint64_t bytes_written;
+    uint64_t distinct_words;
+    uint64_t table_resizes;
+    uint64_t table_size;
+    double mean_probe_length;
+    uint64_t max_probe_length;
+    uint64_t spilled_runs;      /* sorted runs written with --mem-limit */
+    uint64_t spilled_bytes;
+    double blocked_time;        /* seconds spent waiting for input from splitters */
+    double elapsed_time;
+    ResourceUsage usage;
+} BuilderStats;
+
+typedef struct StatsRegion {
+    int fd;
+    void *block;
+    size_t size;
+    int num_splitters;
+    int num_builders;
+    SplitterStats *splitters;
+    BuilderStats *builders;
+} StatsRegion;
+
+/* What the root measured itself */
+typedef struct RootStats {
+    const char *engine;         /* "processes" or "threads" */
+    const char *transport;
+    const char *routing;
+    uint64_t input_files;
+    uint64_t input_bytes;
+    uint64_t chunks;
+    uint64_t total_tokens;
+    uint64_t distinct_words;
+    double split_time;          /* cutting the input into chunks */
+    double merge_time;          /* running the workers and merging their results */
+    double sort_time;           /* selecting the top_k words */
+    double write_time;          /* writing the output file */
+    double total_time;
+    ResourceUsage usage;
+} RootStats;
+
+/* Stats Functions */
+int stats_region_create(StatsRegion *region, int num_splitters, int num_builders);
+int stats_region_map(StatsRegion *region, const char *spec);
+void stats_region_spec(const StatsRegion *region, char *spec, size_t size);
+void stats_region_unmap(StatsRegion *region);
+void stats_usage(ResourceUsage *usage, int who);
+double stats_now(void);
+int stats_write_json(const StatsRegion *region, const RootStats *root, const char *path);
+
+#endif
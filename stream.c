@@ -0,0 +1,423 @@
+/* stream.c */
+
+#include "stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "batch_queue.h"
+#include "tokenizer.h"
+#include "topk.h"
+
+/* A batch without data marks a snapshot boundary in a queue */
+#define IS_MARKER(batch) ((batch)->data == NULL)
+
+typedef struct Stream {
+    const StreamJob *job;
+    BatchQueue *inputs;         /* root -> splitter, one per splitter */
+    BatchQueue *queues;         /* splitter -> builder, one per builder */
+    _Atomic uint64_t tokens_read;
+
+    /* Deltas handed over by the builders for the snapshot in progress */
+    pthread_mutex_t lock;
+    pthread_cond_t published;
+    HashTable **deltas;
+    int num_published;
+
+    /* Root state */
+    HashTable *totals;
+    WordCount *top;
+    size_t top_size;
+    uint64_t total_words;
+    uint64_t snapshots;
+} Stream;
+
+typedef struct StreamSplitter {
+    Stream *stream;
+    int id;
+    TokenBatch *batches;        /* batch being filled for each builder */
+    uint64_t words_sent;
+    uint64_t words_seen;
+} StreamSplitter;
+
+typedef struct StreamBuilder {
+    Stream *stream;
+    int id;
+} StreamBuilder;
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/* Route one cleaned word to its builder's current batch */
+static void stream_word(const char *word, size_t length, void *context) {
+    StreamSplitter *self = context;
+    const StreamJob *job = self->stream->job;
+    self->words_seen++;
+    if (exclusion_set_contains(job->exclusion_set, word, length)) {
+        return;
+    }
+
+    int builder_index;
+    if (job->routing == ROUTE_HASH) {
+        builder_index = partition_for_hash(word_hash(word, length), job->num_builders);
+    } else {
+        builder_index = (int)(self->words_sent % (uint64_t)job->num_builders);
+    }
+
+    TokenBatch *batch = &self->batches[builder_index];
+    if (!token_batch_add(batch, word, length)) {
+        batch_queue_push(&self->stream->queues[builder_index], batch);
+        token_batch_init(batch, BATCH_SIZE);
+        token_batch_add(batch, word, length);
+    }
+    self->words_sent++;
+}
+
+/* Send every partially filled batch on to its builder */
+static void flush_batches(StreamSplitter *self) {
+    for (int i = 0; i < self->stream->job->num_builders; i++) {
+        if (self->batches[i].used > 0) {
+            batch_queue_push(&self->stream->queues[i], &self->batches[i]);
+            token_batch_init(&self->batches[i], BATCH_SIZE);
+        }
+    }
+}
+
+static void *stream_splitter_thread(void *arg) {
+    StreamSplitter *self = arg;
+    Stream *stream = self->stream;
+    int num_builders = stream->job->num_builders;
+
+    for (int i = 0; i < num_builders; i++) {
+        token_batch_init(&self->batches[i], BATCH_SIZE);
+    }
+
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer);
+    TokenBatch block;
+    while (batch_queue_pop(&stream->inputs[self->id], &block)) {
+        if (IS_MARKER(&block)) {
+            // Everything before the marker goes out first, then the marker itself
+            flush_batches(self);
+            for (int i = 0; i < num_builders; i++) {
+                TokenBatch marker = { NULL, 0, 0 };
+                batch_queue_push(&stream->queues[i], &marker);
+            }
+            continue;
+        }
+
+        // Blocks end on a delimiter, so no word carries over into the next one
+        uint64_t seen_before = self->words_seen;
+        tokenizer_feed(&tokenizer, block.data, block.used, stream_word, self);
+        tokenizer_finish(&tokenizer, stream_word, self);
+        atomic_fetch_add_explicit(&stream->tokens_read, self->words_seen - seen_before, memory_order_relaxed);
+        token_batch_free(&block);
+    }
+    tokenizer_free(&tokenizer);
+
+    for (int i = 0; i < num_builders; i++) {
+        if (self->batches[i].used > 0) {
+            batch_queue_push(&stream->queues[i], &self->batches[i]);
+        } else {
+            token_batch_free(&self->batches[i]);
+        }
+        batch_queue_close(&stream->queues[i]);
+    }
+    return NULL;
+}
+
+static void *stream_builder_thread(void *arg) {
+    StreamBuilder *self = arg;
+    Stream *stream = self->stream;
+    int num_splitters = stream->job->num_splitters;
+
+    HashTable *delta = create_hash_table();
+    int markers = 0;
+    TokenBatch batch;
+    while (batch_queue_pop(&stream->queues[self->id], &batch)) {
+        if (IS_MARKER(&batch)) {
+            if (++markers < num_splitters) {
+                continue;
+            }
+            // Every splitter has passed the snapshot boundary: hand the delta over
+            markers = 0;
+            pthread_mutex_lock(&stream->lock);
+            stream->deltas[self->id] = delta;
+            stream->num_published++;
+            pthread_cond_signal(&stream->published);
+            pthread_mutex_unlock(&stream->lock);
+            delta = create_hash_table();
+            continue;
+        }
+
+        size_t position = 0;
+        const char *word;
+        uint32_t length;
+        while (token_batch_next(&batch, &position, &word, &length)) {
+            insert_or_update_word_n(delta, word, length, 1);
+        }
+        token_batch_free(&batch);
+    }
+    free_hash_table(delta);
+    return NULL;
+}
+
+/* Collect every builder's delta, fold it into the totals and refresh the top k */
+static void take_snapshot(Stream *stream, int final) {
+    const StreamJob *job = stream->job;
+    for (int i = 0; i < job->num_splitters; i++) {
+        TokenBatch marker = { NULL, 0, 0 };
+        batch_queue_push(&stream->inputs[i], &marker);
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    while (stream->num_published < job->num_builders) {
+        pthread_cond_wait(&stream->published, &stream->lock);
+    }
+    stream->num_published = 0;
+    pthread_mutex_unlock(&stream->lock);
+
+    // With round-robin routing several builders report the same word, so the
+    // deltas are combined first; every changed word then appears exactly once
+    HashTable *changed = create_hash_table();
+    for (int b = 0; b < job->num_builders; b++) {
+        HashTable *delta = stream->deltas[b];
+        for (size_t i = 0; i < delta->size; i++) {
+            if (delta->ctrl[i] != HASH_SLOT_EMPTY) {
+                insert_or_update_word_n(changed, delta->slots[i].key, delta->slots[i].length, delta->slots[i].count);
+            }
+        }
+        free_hash_table(delta);
+        stream->deltas[b] = NULL;
+    }
+
+    // Counts only grow, so the new top k is drawn from the old top k and the
+    // words that changed; every other word still ranks below the old top k
+    TopK top_words;
+    topk_init(&top_words, job->top_k);
+    for (size_t i = 0; i < stream->top_size; i++) {
+        const WordCount *entry = &stream->top[i];
+        if (!hash_table_find(changed, entry->word, strlen(entry->word))) {
+            topk_offer(&top_words, entry->word, entry->count);
+        }
+    }
+    for (size_t i = 0; i < changed->size; i++) {
+        if (changed->ctrl[i] == HASH_SLOT_EMPTY) {
+            continue;
+        }
+        const HashSlot *slot = &changed->slots[i];
+        insert_or_update_word_n(stream->totals, slot->key, slot->length, slot->count);
+        stream->total_words += slot->count;
+        const HashSlot *total = hash_table_find(stream->totals, slot->key, slot->length);
+        topk_offer(&top_words, total->key, total->count);
+    }
+    stream->top_size = topk_finish(&top_words);
+    memcpy(stream->top, top_words.heap, stream->top_size * sizeof(WordCount));
+    topk_free(&top_words);
+    free_hash_table(changed);
+
+    stream->snapshots++;
+    job->on_snapshot(stream->top, stream->top_size, stream->total_words, stream->snapshots, final, job->context);
+}
+
+/* Hand the first length bytes of *buffer to the next splitter and keep the rest */
+static void hand_block(Stream *stream, char **buffer, size_t *used, size_t *capacity, size_t length, int *next) {
+    TokenBatch block = { *buffer, length, *capacity };
+    char *rest = malloc(*capacity);
+    if (!rest) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(rest, *buffer + length, *used - length);
+    *used -= length;
+    *buffer = rest;
+
+    batch_queue_push(&stream->inputs[*next], &block);
+    *next = (*next + 1) % stream->job->num_splitters;
+}
+
+/* Offset just past the last delimiter in the buffer, or 0 if there is none */
+static size_t last_delimiter_end(const char *buffer, size_t used) {
+    for (size_t i = used; i > 0; i--) {
+        if (buffer[i - 1] != '\0' && strchr(WORD_DELIMITERS, buffer[i - 1])) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* Read the stream until end of input or *stop, taking snapshots as configured */
+static int read_stream(Stream *stream) {
+    const StreamJob *job = stream->job;
+    size_t capacity = STREAM_BLOCK_SIZE, used = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int status = 0;
+    int next_splitter = 0;
+    uint64_t tokens_at_snapshot = 0;
+    double deadline = now_seconds() + job->snapshot_interval;
+    while (!*job->stop) {
+        int timeout = -1;
+        if (job->snapshot_interval > 0) {
+            double remaining = deadline - now_seconds();
+            timeout = remaining > 0 ? (int)(remaining * 1000) + 1 : 0;
+        }
+
+        struct pollfd pfd = { job->input_fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready == -1 && errno != EINTR) {
+            perror("poll input");
+            status = -1;
+            break;
+        }
+        if (ready > 0) {
+            ssize_t n = read(job->input_fd, buffer + used, capacity - used);
+            if (n == -1 && errno != EINTR) {
+                perror("read input");
+                status = -1;
+                break;
+            }
+            if (n == 0) {
+                break;
+            }
+            if (n > 0) {
+                used += (size_t)n;
+                size_t cut = last_delimiter_end(buffer, used);
+                if (cut > 0) {
+                    hand_block(stream, &buffer, &used, &capacity, cut, &next_splitter);
+                } else if (used == capacity) {
+                    // A single word fills the whole buffer: grow it until the word ends
+                    char *temp = realloc(buffer, capacity * 2);
+                    if (!temp) {
+                        perror("realloc");
+                        exit(EXIT_FAILURE);
+                    }
+                    buffer = temp;
+                    capacity *= 2;
+                }
+            }
+        }
+
+        uint64_t tokens = atomic_load_explicit(&stream->tokens_read, memory_order_relaxed);
+        int due = (job->snapshot_interval > 0 && now_seconds() >= deadline) ||
+                  (job->snapshot_tokens > 0 && tokens - tokens_at_snapshot >= job->snapshot_tokens);
+        if (due) {
+            take_snapshot(stream, 0);
+            tokens_at_snapshot = atomic_load_explicit(&stream->tokens_read, memory_order_relaxed);
+            deadline = now_seconds() + job->snapshot_interval;
+        }
+    }
+
+    // The unterminated tail of the stream is its last word
+    if (used > 0) {
+        hand_block(stream, &buffer, &used, &capacity, used, &next_splitter);
+    }
+    free(buffer);
+    return status;
+}
+
+/* Run the streaming engine until the input ends or *job->stop is set. The
+ * final snapshot is always taken, also after a stop or a read error. */
+int run_stream(const StreamJob *job) {
+    int num_splitters = job->num_splitters;
+    int num_builders = job->num_builders;
+
+    Stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.job = job;
+    atomic_init(&stream.tokens_read, 0);
+    pthread_mutex_init(&stream.lock, NULL);
+    pthread_cond_init(&stream.published, NULL);
+    stream.inputs = malloc(num_splitters * sizeof(BatchQueue));
+    stream.queues = malloc(num_builders * sizeof(BatchQueue));
+    stream.deltas = calloc(num_builders, sizeof(HashTable *));
+    stream.top = malloc((job->top_k ? job->top_k : 1) * sizeof(WordCount));
+    StreamSplitter *splitters = calloc(num_splitters, sizeof(StreamSplitter));
+    StreamBuilder *builders = calloc(num_builders, sizeof(StreamBuilder));
+    pthread_t *threads = malloc((num_splitters + num_builders) * sizeof(pthread_t));
+    if (!stream.inputs || !stream.queues || !stream.deltas || !stream.top || !splitters || !builders || !threads) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    stream.totals = create_hash_table();
+
+    /* Pick the tokenizer kernel before any thread needs it */
+    tokenizer_backend();
+
+    // Workers block the stop signals, so they interrupt the root's poll()
+    sigset_t stop_signals, previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+
+    for (int i = 0; i < num_builders; i++) {
+        batch_queue_init(&stream.queues[i], num_splitters);
+        builders[i].stream = &stream;
+        builders[i].id = i;
+        int rc = pthread_create(&threads[num_splitters + i], NULL, stream_builder_thread, &builders[i]);
+        if (rc != 0) {
+            errno = rc;
+            perror("pthread_create builder");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < num_splitters; i++) {
+        batch_queue_init(&stream.inputs[i], 1);
+        splitters[i].stream = &stream;
+        splitters[i].id = i;
+        splitters[i].batches = malloc(num_builders * sizeof(TokenBatch));
+        if (!splitters[i].batches) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        int rc = pthread_create(&threads[i], NULL, stream_splitter_thread, &splitters[i]);
+        if (rc != 0) {
+            errno = rc;
+            perror("pthread_create splitter");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    int status = read_stream(&stream);
+    take_snapshot(&stream, 1);
+
+    for (int i = 0; i < num_splitters; i++) {
+        batch_queue_close(&stream.inputs[i]);
+    }
+    for (int i = 0; i < num_splitters + num_builders; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < num_splitters; i++) {
+        free(splitters[i].batches);
+        batch_queue_free(&stream.inputs[i]);
+    }
+    for (int i = 0; i < num_builders; i++) {
+        batch_queue_free(&stream.queues[i]);
+    }
+    free_hash_table(stream.totals);
+    pthread_mutex_destroy(&stream.lock);
+    pthread_cond_destroy(&stream.published);
+    free(stream.inputs);
+    free(stream.queues);
+    free(stream.deltas);
+    free(stream.top);
+    free(splitters);
+    free(builders);
+    free(threads);
+    return status;
+}
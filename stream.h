@@ -0,0 +1,53 @@
+/* stream.h */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+#include "hash_table.h"
+#include "exclusion_set.h"
+#include "splitter.h"
+
+/*
+ * Streaming engine behind lexan --stream. The root thread reads an unbounded
+ * stream (stdin) and hands delimiter-aligned blocks of it to splitter
+ * threads, which feed builder threads just like the --threads engine.
+ *
+ * Builders count into a delta table that only holds what arrived since the
+ * previous snapshot. To take a snapshot the root sends a marker down every
+ * splitter queue; splitters forward it to every builder after their pending
+ * words, and once a builder has seen the marker of every splitter it hands
+ * its delta to the root and starts a new one. The root folds the deltas into
+ * its running totals and updates the top k from the previous top k plus the
+ * words that changed, so a snapshot costs time in proportion to what changed
+ * rather than to the whole vocabulary.
+ */
+
+#define STREAM_BLOCK_SIZE (64 * 1024)
+#define STREAM_DEFAULT_INTERVAL 10.0            /* seconds between snapshots by default */
+
+/* Called with each snapshot's top words, best first; the words stay valid
+ * until the stream engine returns */
+typedef void (*snapshot_callback)(const WordCount *top, size_t count, uint64_t total_words,
+                                  uint64_t snapshot, int final, void *context);
+
+typedef struct StreamJob {
+    int input_fd;
+    const ExclusionSet *exclusion_set;
+    int num_splitters;
+    int num_builders;
+    RoutingMode routing;
+    size_t top_k;
+    double snapshot_interval;                   /* seconds between snapshots, 0 for none */
+    uint64_t snapshot_tokens;                   /* words read between snapshots, 0 for none */
+    volatile sig_atomic_t *stop;                /* set asynchronously to end the stream early */
+    snapshot_callback on_snapshot;
+    void *context;
+} StreamJob;
+
+/* Stream Functions */
+int run_stream(const StreamJob *job);
+
+#endif
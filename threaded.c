@@ -0,0 +1,255 @@
+/* threaded.c */
+
+#define _GNU_SOURCE
+#include "threaded.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "batch_queue.h"
+#include "tokenizer.h"
+#include "input_range.h"
+
+typedef struct SplitterThread {
+    const ThreadedJob *job;
+    int id;
+    BatchQueue *queues;         /* one per builder */
+    TokenBatch *batches;        /* batch being filled for each builder */
+    uint64_t words_sent;
+    int error;
+    SplitterStats *stats;
+} SplitterThread;
+
+typedef struct BuilderThread {
+    BatchQueue *queue;
+    HashTable *table;
+    ApproxCounter *approx;      /* counts here instead of in table with --approx */
+    double elapsed_time;
+    BuilderStats *stats;
+} BuilderThread;
+
+/* Hand a full batch to its builder, timing how long a full queue holds us up */
+static void push_batch(SplitterThread *self, int builder_index, TokenBatch *batch) {
+    double start = stats_now();
+    self->stats->bytes_written += batch->used;
+    self->stats->frames_sent++;
+    batch_queue_push(&self->queues[builder_index], batch);
+    self->stats->blocked_time += stats_now() - start;
+}
+
+/* Route one cleaned word to its builder's current batch */
+static void batch_word(const char *word, size_t length, void *context) {
+    SplitterThread *self = context;
+    const ThreadedJob *job = self->job;
+    self->stats->tokens_seen++;
+    if (exclusion_set_contains(job->exclusion_set, word, length)) {
+        self->stats->tokens_excluded++;
+        return;
+    }
+
+    int builder_index;
+    if (job->routing == ROUTE_HASH) {
+        builder_index = partition_for_hash(word_hash(word, length), job->num_builders);
+    } else {
+        builder_index = (int)(self->words_sent % (uint64_t)job->num_builders);
+    }
+
+    TokenBatch *batch = &self->batches[builder_index];
+    if (!token_batch_add(batch, word, length)) {
+        push_batch(self, builder_index, batch);
+        token_batch_init(batch, BATCH_SIZE);
+        token_batch_add(batch, word, length);
+    }
+    self->words_sent++;
+}
+
+static void *splitter_thread(void *arg) {
+    SplitterThread *self = arg;
+    const ThreadedJob *job = self->job;
+    double start_time = stats_now();
+
+    for (int i = 0; i < job->num_builders; i++) {
+        token_batch_init(&self->batches[i], BATCH_SIZE);
+    }
+
+    /* Chunks may come from any input file; a file is reopened only when the next chunk is elsewhere */
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer);
+    FILE *in_fp = NULL;
+    size_t file, open_file = SIZE_MAX;
+    off_t offset, length;
+    while (!self->error && chunk_queue_next(job->chunks, &file, &offset, &length)) {
+        if (file != open_file) {
+            if (in_fp) {
+                fclose(in_fp);
+            }
+            in_fp = fopen(chunk_queue_file(job->chunks, file), "r");
+            if (!in_fp) {
+                perror("fopen input_file");
+                self->error = errno;
+                break;
+            }
+            open_file = file;
+        }
+        if (tokenize_file_range(in_fp, offset, length, &tokenizer, batch_word, self, &self->error) == -1) {
+            self->error = EIO;
+        }
+        tokenizer_finish(&tokenizer, batch_word, self);
+        self->stats->chunks++;
+        self->stats->bytes_read += (uint64_t)length;
+    }
+    tokenizer_free(&tokenizer);
+    if (in_fp) {
+        fclose(in_fp);
+    }
+
+    /* Hand over the partial batches and let the builders know this splitter is done */
+    for (int i = 0; i < job->num_builders; i++) {
+        if (self->batches[i].used > 0) {
+            push_batch(self, i, &self->batches[i]);
+        } else {
+            token_batch_free(&self->batches[i]);
+        }
+        batch_queue_close(&self->queues[i]);
+    }
+
+    self->stats->tokens_sent = self->words_sent;
+    self->stats->elapsed_time = stats_now() - start_time;
+    stats_usage(&self->stats->usage, RUSAGE_THREAD);
+    self->stats->reported = 1;
+    return NULL;
+}
+
+static void *builder_thread(void *arg) {
+    BuilderThread *self = arg;
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+
+    TokenBatch batch;
+    BuilderStats *stats = self->stats;
+    for (;;) {
+        double wait_start = stats_now();
+        int more = batch_queue_pop(self->queue, &batch);
+        stats->blocked_time += stats_now() - wait_start;
+        if (!more) {
+            break;
+        }
+        stats->bytes_read += batch.used;
+        size_t position = 0;
+        const char *word;
+        uint32_t length;
+        while (token_batch_next(&batch, &position, &word, &length)) {
+            if (self->approx) {
+                approx_counter_add(self->approx, word, length, 1);
+            } else {
+                insert_or_update_word_n(self->table, word, length, 1);
+            }
+            stats->frames_received++;
+        }
+        token_batch_free(&batch);
+    }
+
+    gettimeofday(&end_time, NULL);
+    self->elapsed_time = (end_time.tv_sec - start_time.tv_sec) +
+                         (end_time.tv_usec - start_time.tv_usec) / 1e6;
+
+    stats->tokens_received = stats->frames_received;
+    stats->distinct_words = self->approx ? self->approx->heavy_hitters.size : self->table->count;
+    stats->table_resizes = self->table->resizes;
+    stats->table_size = self->table->size;
+    size_t max_probe;
+    hash_table_probe_stats(self->table, &stats->mean_probe_length, &max_probe);
+    stats->max_probe_length = max_probe;
+    stats->elapsed_time = self->elapsed_time;
+    stats_usage(&stats->usage, RUSAGE_THREAD);
+    stats->reported = 1;
+    return NULL;
+}
+
+/* Run the job with one thread per splitter and per builder. On success
+ * tables[b] holds the counts of builder b (owned by the caller) and
+ * elapsed_times[b] its counting time. With job->approx_capacity > 0 the
+ * tables stay empty and counters[b] holds builder b's approximate counts,
+ * allocated for the caller. */
+int run_threaded(const ThreadedJob *job, HashTable **tables, ApproxCounter **counters, double *elapsed_times) {
+    int num_splitters = job->num_splitters;
+    int num_builders = job->num_builders;
+
+    BatchQueue *queues = malloc(num_builders * sizeof(BatchQueue));
+    SplitterThread *splitters = calloc(num_splitters, sizeof(SplitterThread));
+    BuilderThread *builders = calloc(num_builders, sizeof(BuilderThread));
+    pthread_t *threads = malloc((num_splitters + num_builders) * sizeof(pthread_t));
+    if (!queues || !splitters || !builders || !threads) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Pick the tokenizer kernel before any thread needs it */
+    tokenizer_backend();
+
+    for (int i = 0; i < num_builders; i++) {
+        batch_queue_init(&queues[i], num_splitters);
+        builders[i].queue = &queues[i];
+        builders[i].table = create_hash_table();
+        if (job->approx_capacity > 0) {
+            builders[i].approx = malloc(sizeof(ApproxCounter));
+            if (!builders[i].approx) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+            approx_counter_init(builders[i].approx, job->approx_capacity);
+        }
+        builders[i].stats = &job->stats->builders[i];
+        int rc = pthread_create(&threads[num_splitters + i], NULL, builder_thread, &builders[i]);
+        if (rc != 0) {
+            errno = rc;
+            perror("pthread_create builder");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < num_splitters; i++) {
+        splitters[i].job = job;
+        splitters[i].id = i;
+        splitters[i].queues = queues;
+        splitters[i].stats = &job->stats->splitters[i];
+        splitters[i].batches = malloc(num_builders * sizeof(TokenBatch));
+        if (!splitters[i].batches) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        int rc = pthread_create(&threads[i], NULL, splitter_thread, &splitters[i]);
+        if (rc != 0) {
+            errno = rc;
+            perror("pthread_create splitter");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int status = 0;
+    for (int i = 0; i < num_splitters + num_builders; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < num_splitters; i++) {
+        if (splitters[i].error) {
+            status = -1;
+        }
+        free(splitters[i].batches);
+    }
+    for (int i = 0; i < num_builders; i++) {
+        tables[i] = builders[i].table;
+        if (counters) {
+            counters[i] = builders[i].approx;
+        }
+        elapsed_times[i] = builders[i].elapsed_time;
+        batch_queue_free(&queues[i]);
+    }
+
+    free(queues);
+    free(splitters);
+    free(builders);
+    free(threads);
+    return status;
+}
@@ -0,0 +1,35 @@
+/* threaded.h */
+
+#ifndef THREADED_H
+#define THREADED_H
+
+#include <sys/types.h>
+#include "hash_table.h"
+#include "exclusion_set.h"
+#include "splitter.h"
+#include "chunk_queue.h"
+#include "stats.h"
+#include "sketch.h"
+
+/*
+ * Single-process engine behind lexan --threads. Splitters and builders run
+ * as threads that share the input mapping and the exclusion set; splitters
+ * pass batches of words to builders through bounded in-memory queues
+ * (batch_queue.h) instead of pipes, and each builder leaves its counts in
+ * its own hash table for the root to merge directly.
+ */
+
+typedef struct ThreadedJob {
+    const ExclusionSet *exclusion_set;
+    ChunkQueue *chunks;         /* input files and byte ranges the splitters pull from */
+    StatsRegion *stats;         /* one slot per splitter and builder thread */
+    int num_splitters;
+    int num_builders;
+    RoutingMode routing;
+    size_t approx_capacity;     /* heavy hitters per builder with --approx, 0 for exact counts */
+} ThreadedJob;
+
+/* Threaded Engine Functions */
+int run_threaded(const ThreadedJob *job, HashTable **tables, ApproxCounter **counters, double *elapsed_times);
+
+#endif
@@ -0,0 +1,290 @@
+/* tokenizer.c */
+
+#include "tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZER_X86 1
+#endif
+
+/* Byte classes, the same rules as strtok(" \t\n") + ispunct + tolower in the C locale.
+ * '\0' is dropped like punctuation so words never contain it. */
+enum {
+    BYTE_KEEP = 0,
+    BYTE_UPPER = 1,
+    BYTE_DROP = 2,
+    BYTE_DELIMITER = 3
+};
+
+static unsigned char byte_class[256];
+
+/* Kernel that classifies one full block: bit i of *delimiters is set if byte i is a
+ * delimiter, bit i of *dirty if byte i is upper case, punctuation or '\0' */
+typedef void (*classify_block_fn)(const unsigned char *p, uint32_t *delimiters, uint32_t *dirty);
+typedef void (*feed_fn)(Tokenizer *tokenizer, const unsigned char *data, size_t length,
+                        token_callback emit, void *context);
+
+static feed_fn selected_feed;
+static const char *selected_backend;
+static pthread_once_t backend_once = PTHREAD_ONCE_INIT;   /* worker threads may start tokenizers together */
+
+static int is_punctuation(int c) {
+    return (c >= 0x21 && c <= 0x2F) || (c >= 0x3A && c <= 0x40) ||
+           (c >= 0x5B && c <= 0x60) || (c >= 0x7B && c <= 0x7E);
+}
+
+/* Classify up to 32 bytes with the lookup table */
+static inline void classify_scalar(const unsigned char *p, size_t n, uint32_t *delimiters, uint32_t *dirty) {
+    uint32_t d = 0, x = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = byte_class[p[i]];
+        d |= (uint32_t)(c == BYTE_DELIMITER) << i;
+        x |= (uint32_t)(c == BYTE_UPPER || c == BYTE_DROP) << i;
+    }
+    *delimiters = d;
+    *dirty = x;
+}
+
+static void classify_block_scalar(const unsigned char *p, uint32_t *delimiters, uint32_t *dirty) {
+    classify_scalar(p, 32, delimiters, dirty);
+}
+
+#ifdef TOKENIZER_X86
+/* SSE2: 16 bytes per block using range compares. All interesting bytes are
+ * ASCII, so signed compares are safe (bytes >= 0x80 compare as negative). */
+__attribute__((target("sse2")))
+static inline void classify_block_sse2(const unsigned char *p, uint32_t *delimiters, uint32_t *dirty) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i d = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+#define IN_RANGE(lo, hi) _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo) - 1)), \
+                                       _mm_cmplt_epi8(v, _mm_set1_epi8((hi) + 1)))
+    /* 0x3A..0x60 covers :;<=>?@, A-Z and [\]^_` */
+    __m128i x = _mm_or_si128(_mm_or_si128(IN_RANGE(0x21, 0x2F), IN_RANGE(0x3A, 0x60)),
+                _mm_or_si128(IN_RANGE(0x7B, 0x7E), _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+#undef IN_RANGE
+    *delimiters = (uint32_t)_mm_movemask_epi8(d);
+    *dirty = (uint32_t)_mm_movemask_epi8(x);
+}
+
+/* AVX2: 32 bytes per block using two nibble lookup tables (vpshufb).
+ * A byte belongs to class bit k when both its high-nibble entry and its
+ * low-nibble entry have bit k set:
+ *   bit 0: hi {2}    lo {0}      ' '            delimiter
+ *   bit 1: hi {0}    lo {9,A}    '\t' '\n'      delimiter
+ *   bit 2: hi {0,6}  lo {0}      '\0' '`'       dirty
+ *   bit 3: hi {2}    lo {1..F}   !"#$%&'()*+,-./ dirty
+ *   bit 4: hi {3}    lo {A..F}   :;<=>?         dirty
+ *   bit 5: hi {4,5}  lo {any}    @ A-Z [\]^_    dirty
+ *   bit 6: hi {7}    lo {B..E}   {|}~           dirty
+ * Bytes >= 0x80 have a high nibble entry of 0 and stay unclassified. */
+__attribute__((target("avx2")))
+static inline void classify_block_avx2(const unsigned char *p, uint32_t *delimiters, uint32_t *dirty) {
+    const __m256i hi_table = _mm256_setr_epi8(
+        0x06, 0, 0x09, 0x10, 0x20, 0x20, 0x04, 0x40, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x06, 0, 0x09, 0x10, 0x20, 0x20, 0x04, 0x40, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i lo_table = _mm256_setr_epi8(
+        0x25, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x2A, 0x3A, 0x78, 0x78, 0x78, 0x78, 0x38,
+        0x25, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x2A, 0x3A, 0x78, 0x78, 0x78, 0x78, 0x38);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+    __m256i lo = _mm256_and_si256(v, low_nibble);
+    __m256i classes = _mm256_and_si256(_mm256_shuffle_epi8(hi_table, hi), _mm256_shuffle_epi8(lo_table, lo));
+
+    __m256i zero = _mm256_setzero_si256();
+    __m256i not_delimiter = _mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_set1_epi8(0x03)), zero);
+    __m256i not_dirty = _mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_set1_epi8(0x7C)), zero);
+    *delimiters = ~(uint32_t)_mm256_movemask_epi8(not_delimiter);
+    *dirty = ~(uint32_t)_mm256_movemask_epi8(not_dirty);
+}
+#endif
+
+/* Append the cleaned form of raw bytes to the tokenizer's buffer */
+static void append_cleaned(Tokenizer *tokenizer, const unsigned char *data, size_t length) {
+    if (tokenizer->length + length > tokenizer->capacity) {
+        size_t new_capacity = tokenizer->capacity ? tokenizer->capacity * 2 : 64;
+        while (tokenizer->length + length > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *temp = realloc(tokenizer->buffer, new_capacity);
+        if (!temp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        tokenizer->buffer = temp;
+        tokenizer->capacity = new_capacity;
+    }
+    char *out = tokenizer->buffer + tokenizer->length;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = data[i];
+        unsigned char cls = byte_class[c];
+        if (cls == BYTE_KEEP) {
+            *out++ = (char)c;
+        } else if (cls == BYTE_UPPER) {
+            *out++ = (char)(c + ('a' - 'A'));
+        }
+    }
+    tokenizer->length = (size_t)(out - tokenizer->buffer);
+}
+
+/* A word [start, end) of the current chunk has ended */
+static inline void end_word(Tokenizer *tokenizer, const unsigned char *data, size_t start, size_t end,
+                            int dirty, token_callback emit, void *context) {
+    if (!tokenizer->continued && !dirty) {
+        /* Nothing to clean: report a view into the caller's buffer */
+        emit((const char *)data + start, end - start, context);
+        return;
+    }
+    append_cleaned(tokenizer, data + start, end - start);
+    if (tokenizer->length > 0) {
+        emit(tokenizer->buffer, tokenizer->length, context);
+    }
+    tokenizer->length = 0;
+    tokenizer->continued = 0;
+}
+
+/* Shared scanning loop, inlined into every backend with its block kernel */
+static inline __attribute__((always_inline))
+void feed_blocks(Tokenizer *tokenizer, const unsigned char *data, size_t length,
+                 token_callback emit, void *context, size_t width, classify_block_fn classify) {
+    int inside = tokenizer->continued;
+    int dirty = 0;
+    size_t start = 0;
+
+    for (size_t base = 0; base < length; base += width) {
+        size_t n = length - base < width ? length - base : width;
+        uint32_t delimiters, dirty_bytes;
+        if (n == width) {
+            classify(data + base, &delimiters, &dirty_bytes);
+        } else {
+            classify_scalar(data + base, n, &delimiters, &dirty_bytes);
+        }
+        uint32_t valid = n == 32 ? UINT32_MAX : ((1u << n) - 1);
+
+        size_t offset = 0;
+        while (offset < n) {
+            uint32_t ahead = valid & (UINT32_MAX << offset);
+            if (inside) {
+                uint32_t ends = delimiters & ahead;
+                if (!ends) {
+                    dirty |= (dirty_bytes & ahead) != 0;
+                    break;
+                }
+                size_t end = (size_t)__builtin_ctz(ends);
+                dirty |= (dirty_bytes & ahead & ((1u << end) - 1)) != 0;
+                end_word(tokenizer, data, start, base + end, dirty, emit, context);
+                inside = 0;
+                offset = end;
+            } else {
+                uint32_t starts = ~delimiters & ahead;
+                if (!starts) {
+                    break;
+                }
+                offset = (size_t)__builtin_ctz(starts);
+                start = base + offset;
+                dirty = 0;
+                inside = 1;
+            }
+        }
+    }
+
+    /* A word running into the end of the chunk is kept until the next chunk */
+    if (inside) {
+        append_cleaned(tokenizer, data + start, length - start);
+        tokenizer->continued = 1;
+    }
+}
+
+static void feed_scalar(Tokenizer *tokenizer, const unsigned char *data, size_t length,
+                        token_callback emit, void *context) {
+    feed_blocks(tokenizer, data, length, emit, context, 32, classify_block_scalar);
+}
+
+#ifdef TOKENIZER_X86
+__attribute__((target("sse2")))
+static void feed_sse2(Tokenizer *tokenizer, const unsigned char *data, size_t length,
+                      token_callback emit, void *context) {
+    feed_blocks(tokenizer, data, length, emit, context, 16, classify_block_sse2);
+}
+
+__attribute__((target("avx2")))
+static void feed_avx2(Tokenizer *tokenizer, const unsigned char *data, size_t length,
+                      token_callback emit, void *context) {
+    feed_blocks(tokenizer, data, length, emit, context, 32, classify_block_avx2);
+}
+#endif
+
+/* Build the byte class table and pick the widest kernel the CPU supports */
+static void select_backend(void) {
+    for (int c = 0; c < 256; c++) {
+        if (c == ' ' || c == '\t' || c == '\n') {
+            byte_class[c] = BYTE_DELIMITER;
+        } else if (c == '\0' || is_punctuation(c)) {
+            byte_class[c] = BYTE_DROP;
+        } else if (c >= 'A' && c <= 'Z') {
+            byte_class[c] = BYTE_UPPER;
+        } else {
+            byte_class[c] = BYTE_KEEP;
+        }
+    }
+
+    selected_feed = feed_scalar;
+    selected_backend = "scalar";
+#ifdef TOKENIZER_X86
+    __builtin_cpu_init();
+    const char *forced = getenv("LEXAN_TOKENIZER");
+    if (forced && strcmp(forced, "scalar") == 0) {
+        return;
+    }
+    if (__builtin_cpu_supports("avx2") && !(forced && strcmp(forced, "sse2") == 0)) {
+        selected_feed = feed_avx2;
+        selected_backend = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        selected_feed = feed_sse2;
+        selected_backend = "sse2";
+    }
+#endif
+}
+
+/* Initialize a tokenizer */
+void tokenizer_init(Tokenizer *tokenizer) {
+    pthread_once(&backend_once, select_backend);
+    tokenizer->buffer = NULL;
+    tokenizer->length = 0;
+    tokenizer->capacity = 0;
+    tokenizer->continued = 0;
+}
+
+/* Tokenize the next chunk of input */
+void tokenizer_feed(Tokenizer *tokenizer, const char *data, size_t length, token_callback emit, void *context) {
+    selected_feed(tokenizer, (const unsigned char *)data, length, emit, context);
+}
+
+/* Report a word left open by the last chunk */
+void tokenizer_finish(Tokenizer *tokenizer, token_callback emit, void *context) {
+    if (tokenizer->continued && tokenizer->length > 0) {
+        emit(tokenizer->buffer, tokenizer->length, context);
+    }
+    tokenizer->length = 0;
+    tokenizer->continued = 0;
+}
+
+/* Release the tokenizer's buffer */
+void tokenizer_free(Tokenizer *tokenizer) {
+    free(tokenizer->buffer);
+    tokenizer->buffer = NULL;
+    tokenizer->length = tokenizer->capacity = 0;
+}
+
+/* Name of the kernel chosen at run time ("avx2", "sse2" or "scalar") */
+const char *tokenizer_backend(void) {
+    pthread_once(&backend_once, select_backend);
+    return selected_backend;
+}
@@ -0,0 +1,39 @@
+/* tokenizer.h */
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+
+/* Bytes that separate words (shared by the tokenizer and lexan's input splitting) */
+#define WORD_DELIMITERS " \t\n"
+
+/*
+ * Single-pass tokenizer: splits the input on WORD_DELIMITERS, drops ASCII
+ * punctuation and folds ASCII upper case, all while scanning the bytes once.
+ * Input is classified 16 or 32 bytes at a time (SSE2 or AVX2, picked at run
+ * time, with a scalar fallback). Words that need no change are handed to the
+ * callback as views into the caller's buffer; only words that contain upper
+ * case or punctuation are copied. Words may span consecutive chunks passed to
+ * tokenizer_feed. Words that are empty after cleaning are not reported.
+ * Setting LEXAN_TOKENIZER=sse2 or =scalar forces a narrower kernel.
+ */
+
+/* Called for every word; the bytes are only valid during the call */
+typedef void (*token_callback)(const char *word, size_t length, void *context);
+
+typedef struct Tokenizer {
+    char *buffer;           /* cleaned bytes of a copied word */
+    size_t length;
+    size_t capacity;
+    int continued;          /* the last chunk ended inside a word */
+} Tokenizer;
+
+/* Tokenizer Functions */
+void tokenizer_init(Tokenizer *tokenizer);
+void tokenizer_feed(Tokenizer *tokenizer, const char *data, size_t length, token_callback emit, void *context);
+void tokenizer_finish(Tokenizer *tokenizer, token_callback emit, void *context);
+void tokenizer_free(Tokenizer *tokenizer);
+const char *tokenizer_backend(void);
+
+#endif
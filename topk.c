@@ -0,0 +1,87 @@
+/* topk.c */
+
+#include "topk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Initialize a selector for the k best entries */
+void topk_init(TopK *topk, size_t k) {
+    topk->size = 0;
+    topk->capacity = k;
+    topk->heap = malloc((k ? k : 1) * sizeof(WordCount));
+    if (!topk->heap) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Output order: higher count first, then smaller word first */
+int word_count_precedes(const WordCount *a, const WordCount *b) {
+    if (a->count != b->count) {
+        return a->count > b->count;
+    }
+    return strcmp(a->word, b->word) < 0;
+}
+
+/* Restore the heap below index i; the root is the entry that precedes all others least */
+static void sift_down(TopK *topk, size_t i) {
+    WordCount *heap = topk->heap;
+    for (;;) {
+        size_t weakest = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < topk->size && word_count_precedes(&heap[weakest], &heap[left])) {
+            weakest = left;
+        }
+        if (right < topk->size && word_count_precedes(&heap[weakest], &heap[right])) {
+            weakest = right;
+        }
+        if (weakest == i) {
+            return;
+        }
+        WordCount temp = heap[i];
+        heap[i] = heap[weakest];
+        heap[weakest] = temp;
+        i = weakest;
+    }
+}
+
+static void sift_up(TopK *topk, size_t i) {
+    WordCount *heap = topk->heap;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!word_count_precedes(&heap[parent], &heap[i])) {
+            return;
+        }
+        WordCount temp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = temp;
+        i = parent;
+    }
+}
+
+/* Offer an entry; it is kept only if it belongs to the current top k */
+void topk_offer(TopK *topk, const char *word, uint64_t count) {
+    WordCount entry = { .word = word, .count = count };
+    if (topk->size < topk->capacity) {
+        topk->heap[topk->size++] = entry;
+        sift_up(topk, topk->size - 1);
+    } else if (topk->capacity > 0 && word_count_precedes(&entry, &topk->heap[0])) {
+        topk->heap[0] = entry;
+        sift_down(topk, 0);
+    }
+}
+
+/* Sort the selected entries into output order (topk->heap[0] is the best).
+ * Returns the number of entries; no more entries may be offered afterwards. */
+size_t topk_finish(TopK *topk) {
+    qsort(topk->heap, topk->size, sizeof(WordCount), compare_counts);
+    return topk->size;
+}
+
+/* Release the selector */
+void topk_free(TopK *topk) {
+    free(topk->heap);
+    topk->heap = NULL;
+    topk->size = topk->capacity = 0;
+}
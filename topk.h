@@ -0,0 +1,27 @@
+/* topk.h */
+
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <stddef.h>
+#include "hash_table.h"
+
+/* Bounded selection of the K entries with the highest counts.
+ * Entries are kept in a min-heap whose root is the weakest candidate, so
+ * selecting from N entries costs O(N log K). Ties on the count are broken
+ * by the word (ascending), which makes the result independent of the order
+ * in which entries are offered. Words are referenced, not copied. */
+typedef struct TopK {
+    WordCount *heap;
+    size_t size;
+    size_t capacity;
+} TopK;
+
+/* Top-K Functions */
+void topk_init(TopK *topk, size_t k);
+void topk_offer(TopK *topk, const char *word, uint64_t count);
+size_t topk_finish(TopK *topk);
+void topk_free(TopK *topk);
+int word_count_precedes(const WordCount *a, const WordCount *b);
+
+#endif
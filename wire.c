@@ -0,0 +1,377 @@
+/* wire.c */
+
+#include "wire.h"
+#include "ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+/* Initialize a buffered writer on fd */
+void wire_writer_init(WireWriter *writer, int fd, size_t capacity) {
+    writer->fd = fd;
+    writer->ring = NULL;
+    writer->used = 0;
+    writer->capacity = capacity;
+    writer->bytes_written = 0;
+    writer->blocked_time = 0;
+    writer->buffer = malloc(capacity);
+    if (!writer->buffer) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Initialize a buffered writer that produces into a shared-memory ring */
+void wire_writer_init_ring(WireWriter *writer, struct Ring *ring, size_t capacity) {
+    wire_writer_init(writer, -1, capacity);
+    writer->ring = ring;
+}
+
+/* Write the whole buffer to the file descriptor or ring */
+static int wire_write_all(WireWriter *writer) {
+    if (writer->ring) {
+        return ring_write(writer->ring, writer->buffer, writer->used);
+    }
+    size_t done = 0;
+    while (done < writer->used) {
+        ssize_t n = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/* Flush the buffer, timing how long the consumer kept the writer waiting */
+int wire_flush(WireWriter *writer) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = wire_write_all(writer);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    writer->blocked_time += (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    if (status == -1) {
+        return -1;
+    }
+    writer->bytes_written += writer->used;
+    writer->used = 0;
+    return 0;
+}
+
+/* Make room for a frame of the given size, flushing or growing the buffer */
+static int wire_reserve(WireWriter *writer, size_t size) {
+    if (writer->used + size <= writer->capacity) {
+        return 0;
+    }
+    if (wire_flush(writer) == -1) {
+        return -1;
+    }
+    if (size > writer->capacity) {
+        char *temp = realloc(writer->buffer, size);
+        if (!temp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        writer->buffer = temp;
+        writer->capacity = size;
+    }
+    return 0;
+}
+
+/* Append raw bytes to the buffer; the caller has reserved the space */
+static void wire_put(WireWriter *writer, const void *data, size_t size) {
+    memcpy(writer->buffer + writer->used, data, size);
+    writer->used += size;
+}
+
+/* Frame a word for a builder: [u32 length][bytes]['\0'] */
+int wire_write_word(WireWriter *writer, const char *word, size_t length) {
+    if (length > WIRE_MAX_WORD_LENGTH) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    uint32_t len32 = (uint32_t)length;
+    if (wire_reserve(writer, sizeof(len32) + length + 1) == -1) {
+        return -1;
+    }
+    wire_put(writer, &len32, sizeof(len32));
+    wire_put(writer, word, length);
+    writer->buffer[writer->used++] = '\0';
+    return 0;
+}
+
+/* Frame a word count for the root: [u32 length][bytes]['\0'][u64 count] */
+int wire_write_count(WireWriter *writer, const char *word, size_t length, uint64_t count) {
+    if (length >= WIRE_BOUNDED_FLAG) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    uint32_t len32 = (uint32_t)length;
+    if (wire_reserve(writer, sizeof(len32) + length + 1 + sizeof(count)) == -1) {
+        return -1;
+    }
+    wire_put(writer, &len32, sizeof(len32));
+    wire_put(writer, word, length);
+    writer->buffer[writer->used++] = '\0';
+    wire_put(writer, &count, sizeof(count));
+    return 0;
+}
+
+/* Frame a heavy hitter for the root: [u32 length | WIRE_BOUNDED_FLAG][bytes]['\0'][u64 count][u64 error] */
+int wire_write_bounded_count(WireWriter *writer, const char *word, size_t length, uint64_t count, uint64_t error) {
+    if (length >= WIRE_BOUNDED_FLAG) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    uint32_t len32 = (uint32_t)length | WIRE_BOUNDED_FLAG;
+    if (wire_reserve(writer, sizeof(len32) + length + 1 + sizeof(count) + sizeof(error)) == -1) {
+        return -1;
+    }
+    wire_put(writer, &len32, sizeof(len32));
+    wire_put(writer, word, length);
+    writer->buffer[writer->used++] = '\0';
+    wire_put(writer, &count, sizeof(count));
+    wire_put(writer, &error, sizeof(error));
+    return 0;
+}
+
+/* Frame one sketch row for the root: [u32 WIRE_SKETCH_LENGTH][WireSketchRow][width u64 counters] */
+int wire_write_sketch_row(WireWriter *writer, const WireSketchRow *header, const uint64_t *counters) {
+    uint32_t marker = WIRE_SKETCH_LENGTH;
+    size_t counters_size = (size_t)header->width * sizeof(uint64_t);
+    if (wire_reserve(writer, sizeof(marker) + sizeof(*header) + counters_size) == -1) {
+        return -1;
+    }
+    wire_put(writer, &marker, sizeof(marker));
+    wire_put(writer, header, sizeof(*header));
+    wire_put(writer, counters, counters_size);
+    return 0;
+}
+
+/* Frame a pre-aggregated word for a builder: [u32 length | WIRE_COUNTED_FLAG][bytes]['\0'][u64 count] */
+int wire_write_counted_word(WireWriter *writer, const char *word, size_t length, uint64_t count) {
+    if (length >= WIRE_MAX_WORD_LENGTH) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    uint32_t len32 = (uint32_t)length | WIRE_COUNTED_FLAG;
+    if (wire_reserve(writer, sizeof(len32) + length + 1 + sizeof(count)) == -1) {
+        return -1;
+    }
+    wire_put(writer, &len32, sizeof(len32));
+    wire_put(writer, word, length);
+    writer->buffer[writer->used++] = '\0';
+    wire_put(writer, &count, sizeof(count));
+    return 0;
+}
+
+/* Frame the builder's summary: [u32 WIRE_TRAILER_LENGTH][WireTrailer] */
+int wire_write_trailer(WireWriter *writer, const WireTrailer *trailer) {
+    uint32_t marker = WIRE_TRAILER_LENGTH;
+    if (wire_reserve(writer, sizeof(marker) + sizeof(*trailer)) == -1) {
+        return -1;
+    }
+    wire_put(writer, &marker, sizeof(marker));
+    wire_put(writer, trailer, sizeof(*trailer));
+    return 0;
+}
+
+/* Release the writer's buffer (does not flush or close the fd) */
+void wire_writer_free(WireWriter *writer) {
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->used = writer->capacity = 0;
+}
+
+/* Initialize a buffered reader on fd */
+void wire_reader_init(WireReader *reader, int fd, size_t capacity) {
+    reader->fd = fd;
+    reader->ring = NULL;
+    reader->start = reader->end = 0;
+    reader->capacity = capacity;
+    reader->bytes_read = 0;
+    reader->buffer = malloc(capacity);
+    if (!reader->buffer) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Initialize a buffered reader that consumes from a shared-memory ring */
+void wire_reader_init_ring(WireReader *reader, struct Ring *ring, size_t capacity) {
+    wire_reader_init(reader, -1, capacity);
+    reader->ring = ring;
+}
+
+/* Read once from the fd (or ring, which never blocks) into the buffer.
+ * Returns the number of bytes read, 0 at end of file, -1 on error (errno is set,
+ * EAGAIN for a non-blocking fd with no data). Pointers previously returned by
+ * wire_next_word/wire_next_record are invalidated. */
+ssize_t wire_reader_fill(WireReader *reader) {
+    if (reader->start == reader->end) {
+        reader->start = reader->end = 0;
+    }
+    if (reader->end == reader->capacity) {
+        if (reader->start > 0) {
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        } else {
+            size_t new_capacity = reader->capacity * 2;
+            char *temp = realloc(reader->buffer, new_capacity);
+            if (!temp) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            reader->buffer = temp;
+            reader->capacity = new_capacity;
+        }
+    }
+
+    ssize_t n;
+    if (reader->ring) {
+        n = ring_read(reader->ring, reader->buffer + reader->end, reader->capacity - reader->end);
+    } else {
+        do {
+            n = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        } while (n == -1 && errno == EINTR);
+    }
+    if (n > 0) {
+        reader->end += (size_t)n;
+        reader->bytes_read += (uint64_t)n;
+    }
+    return n;
+}
+
+/* Number of buffered bytes not yet consumed */
+size_t wire_reader_pending(const WireReader *reader) {
+    return reader->end - reader->start;
+}
+
+/* Parse the next word frame from the buffer.
+ * Returns 1 if a word is available, 0 if more data is needed, -1 if malformed. */
+int wire_next_word(WireReader *reader, const char **word, uint32_t *length) {
+    size_t available = reader->end - reader->start;
+    uint32_t len32;
+    if (available < sizeof(len32)) {
+        return 0;
+    }
+    memcpy(&len32, reader->buffer + reader->start, sizeof(len32));
+    if (len32 > WIRE_MAX_WORD_LENGTH) {
+        return -1;
+    }
+    if (available < sizeof(len32) + len32 + 1) {
+        return 0;
+    }
+    *word = reader->buffer + reader->start + sizeof(len32);
+    *length = len32;
+    reader->start += sizeof(len32) + len32 + 1;
+    return 1;
+}
+
+/* Parse the next plain or counted word frame from the buffer; plain words count once.
+ * Returns 1 if a word is available, 0 if more data is needed, -1 if malformed. */
+int wire_next_counted_word(WireReader *reader, const char **word, uint32_t *length, uint64_t *count) {
+    size_t available = reader->end - reader->start;
+    uint32_t len32;
+    if (available < sizeof(len32)) {
+        return 0;
+    }
+    memcpy(&len32, reader->buffer + reader->start, sizeof(len32));
+    if (!(len32 & WIRE_COUNTED_FLAG)) {
+        *count = 1;
+        return wire_next_word(reader, word, length);
+    }
+
+    len32 &= ~WIRE_COUNTED_FLAG;
+    if (len32 == WIRE_MAX_WORD_LENGTH) {
+        return -1;
+    }
+    size_t frame_size = sizeof(len32) + len32 + 1 + sizeof(uint64_t);
+    if (available < frame_size) {
+        return 0;
+    }
+    *word = reader->buffer + reader->start + sizeof(len32);
+    *length = len32;
+    memcpy(count, reader->buffer + reader->start + sizeof(len32) + len32 + 1, sizeof(uint64_t));
+    reader->start += frame_size;
+    return 1;
+}
+
+/* Parse the next word count, sketch row or trailer frame from the buffer.
+ * Returns 1 if a record is available, 0 if more data is needed, -1 if malformed. */
+int wire_next_record(WireReader *reader, WireRecord *record) {
+    size_t available = reader->end - reader->start;
+    const char *frame = reader->buffer + reader->start;
+    uint32_t len32;
+    if (available < sizeof(len32)) {
+        return 0;
+    }
+    memcpy(&len32, frame, sizeof(len32));
+
+    if (len32 == WIRE_TRAILER_LENGTH) {
+        if (available < sizeof(len32) + sizeof(WireTrailer)) {
+            return 0;
+        }
+        record->is_trailer = 1;
+        record->is_sketch_row = 0;
+        record->word = NULL;
+        record->length = 0;
+        record->count = record->error = 0;
+        memcpy(&record->trailer, frame + sizeof(len32), sizeof(WireTrailer));
+        reader->start += sizeof(len32) + sizeof(WireTrailer);
+        return 1;
+    }
+    if (len32 == WIRE_SKETCH_LENGTH) {
+        WireSketchRow header;
+        if (available < sizeof(len32) + sizeof(header)) {
+            return 0;
+        }
+        memcpy(&header, frame + sizeof(len32), sizeof(header));
+        size_t frame_size = sizeof(len32) + sizeof(header) + (size_t)header.width * sizeof(uint64_t);
+        if (available < frame_size) {
+            return 0;
+        }
+        record->is_trailer = 0;
+        record->is_sketch_row = 1;
+        record->sketch_row = header;
+        record->counters = frame + sizeof(len32) + sizeof(header);
+        record->word = NULL;
+        record->length = 0;
+        record->count = record->error = 0;
+        reader->start += frame_size;
+        return 1;
+    }
+    if (len32 > WIRE_MAX_WORD_LENGTH) {
+        return -1;
+    }
+
+    int bounded = (len32 & WIRE_BOUNDED_FLAG) != 0;
+    len32 &= ~WIRE_BOUNDED_FLAG;
+    size_t frame_size = sizeof(len32) + len32 + 1 + (bounded ? 2 : 1) * sizeof(uint64_t);
+    if (available < frame_size) {
+        return 0;
+    }
+    record->is_trailer = 0;
+    record->is_sketch_row = 0;
+    record->word = frame + sizeof(len32);
+    record->length = len32;
+    memcpy(&record->count, frame + sizeof(len32) + len32 + 1, sizeof(uint64_t));
+    record->error = 0;
+    if (bounded) {
+        memcpy(&record->error, frame + sizeof(len32) + len32 + 1 + sizeof(uint64_t), sizeof(uint64_t));
+    }
+    reader->start += frame_size;
+    return 1;
+}
+
+/* Release the reader's buffer (does not close the fd) */
+void wire_reader_free(WireReader *reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+    reader->start = reader->end = reader->capacity = 0;
+}
@@ -0,0 +1,109 @@
+/* wire.h */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Binary framing used on the pipes between splitters, builders and the root.
+ *
+ * splitter -> builder:  [u32 length][length bytes]['\0']
+ *                   or  [u32 length | WIRE_COUNTED_FLAG][length bytes]['\0'][u64 count]
+ *                       when a splitter pre-aggregates its words (--combine)
+ * builder  -> root:     [u32 length][length bytes]['\0'][u64 count]
+ *                   or  [u32 length | WIRE_BOUNDED_FLAG][length bytes]['\0'][u64 count][u64 error]
+ *                       for the heavy hitters of an approximate builder (--approx),
+ *                       preceded by its sketch as [u32 WIRE_SKETCH_LENGTH][WireSketchRow]
+ *                       [width u64 counters] records, one per row
+ *
+ * The terminating '\0' lets readers hand out words as C strings straight
+ * from their buffer. Lengths above WIRE_MAX_WORD_LENGTH are reserved for
+ * control records, such as the builder's trailer.
+ */
+
+#define WIRE_BUFFER_SIZE (64 * 1024)
+#define WIRE_MAX_WORD_LENGTH 0x7FFFFFFFu
+#define WIRE_TRAILER_LENGTH 0xFFFFFFFFu
+#define WIRE_SKETCH_LENGTH 0xFFFFFFFEu
+#define WIRE_COUNTED_FLAG 0x80000000u
+#define WIRE_BOUNDED_FLAG 0x40000000u
+
+/* Summary a builder sends to the root after its last word count */
+typedef struct WireTrailer {
+    double elapsed_time;
+    uint64_t total_count;       /* sum of the counts of all words the builder saw */
+    uint64_t distinct_words;    /* words in the builder's table, sent or not */
+} WireTrailer;
+
+/* Header of one row of an approximate builder's Count-Min Sketch (sketch.h) */
+typedef struct WireSketchRow {
+    uint32_t depth;
+    uint32_t width;
+    uint32_t row;
+    uint32_t reserved;
+    uint64_t floor;             /* most occurrences of a word missing from the builder's list */
+} WireSketchRow;
+
+struct Ring;
+
+/* Writers and readers move bytes through fd, or through a shared-memory
+ * ring (ring.h) when ring is set */
+typedef struct WireWriter {
+    int fd;
+    struct Ring *ring;
+    char *buffer;
+    size_t used;
+    size_t capacity;
+    uint64_t bytes_written;     /* bytes handed to fd or ring so far */
+    double blocked_time;        /* seconds spent in write() or waiting on a full ring */
+} WireWriter;
+
+typedef struct WireReader {
+    int fd;
+    struct Ring *ring;
+    char *buffer;
+    size_t start;
+    size_t end;
+    size_t capacity;
+    uint64_t bytes_read;        /* bytes taken from fd or ring so far */
+} WireReader;
+
+/* One record of the builder -> root stream */
+typedef struct WireRecord {
+    const char *word;
+    uint32_t length;
+    uint64_t count;
+    uint64_t error;             /* overestimate bound of count, 0 for exact counts */
+    int is_trailer;
+    WireTrailer trailer;
+    int is_sketch_row;
+    WireSketchRow sketch_row;
+    const char *counters;       /* the row's width counters, possibly unaligned */
+} WireRecord;
+
+/* Writer Functions */
+void wire_writer_init(WireWriter *writer, int fd, size_t capacity);
+void wire_writer_init_ring(WireWriter *writer, struct Ring *ring, size_t capacity);
+int wire_write_word(WireWriter *writer, const char *word, size_t length);
+int wire_write_count(WireWriter *writer, const char *word, size_t length, uint64_t count);
+int wire_write_counted_word(WireWriter *writer, const char *word, size_t length, uint64_t count);
+int wire_write_bounded_count(WireWriter *writer, const char *word, size_t length, uint64_t count, uint64_t error);
+int wire_write_sketch_row(WireWriter *writer, const WireSketchRow *header, const uint64_t *counters);
+int wire_write_trailer(WireWriter *writer, const WireTrailer *trailer);
+int wire_flush(WireWriter *writer);
+void wire_writer_free(WireWriter *writer);
+
+/* Reader Functions */
+void wire_reader_init(WireReader *reader, int fd, size_t capacity);
+void wire_reader_init_ring(WireReader *reader, struct Ring *ring, size_t capacity);
+ssize_t wire_reader_fill(WireReader *reader);
+int wire_next_word(WireReader *reader, const char **word, uint32_t *length);
+int wire_next_counted_word(WireReader *reader, const char **word, uint32_t *length, uint64_t *count);
+int wire_next_record(WireReader *reader, WireRecord *record);
+size_t wire_reader_pending(const WireReader *reader);
+void wire_reader_free(WireReader *reader);
+
+#endif